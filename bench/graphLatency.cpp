@@ -0,0 +1,246 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+// Open-loop end-to-end latency benchmark for a linear multi-stage graph.
+//
+// Usage: graphLatency [--stages N] [--work-ns NS] [--count N]
+//                     [--arrivals constant|poisson] [--executor threaded|inline]
+//                     [--rate R | --sweep START MAX FACTOR] [--slo-us US]
+//
+//   threaded: one concurrent_proc_node per stage, each on its own thread.
+//   inline:   proc_nodes driven by a graph_executor on the injecting thread.
+
+#include "concurrent_proc_node.hpp"
+#include "graph_executor.hpp"
+#include "latency_harness.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/vector.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+//==============================================================================
+typedef boost::fusion::vector<size_t> tuple_t;
+
+/** Spin for roughly workNanos, standing in for per-stage processing. */
+inline void burn(unsigned workNanos)
+{
+  open_loop_harness::clock_t::time_point const end =
+    open_loop_harness::clock_t::now() + boost::chrono::nanoseconds(workNanos);
+  while (open_loop_harness::clock_t::now() < end)
+    ;
+}
+
+//------------------------------------------------------------------------------
+class threaded_stage
+: public concurrent_proc_node<threaded_stage, tuple_t, tuple_t>
+{
+public:
+  explicit threaded_stage(unsigned workNanos)
+  : concurrent_proc_node<threaded_stage, tuple_t, tuple_t>(4096),
+    m_workNanos(workNanos)
+  {}
+
+  tuple_t visit_impl()
+  {
+    burn(m_workNanos);
+    return this->input();
+  }
+
+private:
+  unsigned m_workNanos;
+};
+
+class inline_stage : public proc_node<inline_stage, tuple_t, tuple_t>
+{
+public:
+  explicit inline_stage(unsigned workNanos)
+  : proc_node<inline_stage, tuple_t, tuple_t>(), m_workNanos(workNanos) {}
+
+  tuple_t visit_impl()
+  {
+    burn(m_workNanos);
+    return this->inputQueue().front();
+  }
+
+private:
+  unsigned m_workNanos;
+};
+
+//==============================================================================
+struct options
+{
+  options()
+  : stages(4), workNanos(1000), count(20000), kind(arrival_process::poisson),
+    threaded(true), rate(10000.0), sweepMax(0.0), sweepFactor(2.0),
+    sloMicros(1000)
+  {}
+
+  size_t stages;
+  unsigned workNanos;
+  size_t count;
+  arrival_process::kind_t kind;
+  bool threaded;
+  double rate;
+  double sweepMax;
+  double sweepFactor;
+  unsigned sloMicros;
+};
+
+//------------------------------------------------------------------------------
+/** Push into a stage, spinning while its ring is full. */
+void push(threaded_stage * stage, size_t id)
+{
+  while (! stage->enqueue<0>(id))
+    boost::this_thread::yield();
+}
+
+/** Worker loop for one threaded stage. */
+void stage_worker(threaded_stage * stage,
+                  boost::function<void (size_t)> next,
+                  const boost::atomic<bool> * stop)
+{
+  while (! stop->load(boost::memory_order_relaxed))
+  {
+    if (! stage->is_ready())
+    {
+      boost::this_thread::yield();
+      continue;
+    }
+
+    next(boost::fusion::at_c<0>(stage->visit()));
+  }
+}
+
+load_result run_threaded(const options & opt, double rate)
+{
+  open_loop_harness harness(arrival_process(opt.kind, rate), opt.count);
+
+  boost::ptr_vector<threaded_stage> stages;
+  for (size_t s = 0; s < opt.stages; ++s)
+    stages.push_back(new threaded_stage(opt.workNanos));
+
+  boost::atomic<bool> stop(false);
+  boost::thread_group workers;
+  for (size_t s = 0; s < opt.stages; ++s)
+  {
+    boost::function<void (size_t)> next;
+    if (s + 1 < opt.stages)
+      next = boost::bind(& push, & stages[s + 1], _1);
+    else
+      next = boost::bind(& open_loop_harness::complete, & harness, _1);
+    workers.create_thread(boost::bind(& stage_worker, & stages[s], next,
+                                      & stop));
+  }
+
+  load_result const result = harness.run(boost::bind(& push, & stages[0], _1));
+
+  stop = true;
+  workers.join_all();
+  return result;
+}
+
+//------------------------------------------------------------------------------
+void inject_inline(inline_stage * first, graph_executor * exec, size_t id)
+{
+  first->enqueue<0>(id);
+  exec->run();
+}
+
+void complete_inline(open_loop_harness * harness, const tuple_t & output)
+{ harness->complete(boost::fusion::at_c<0>(output)); }
+
+load_result run_inline(const options & opt, double rate)
+{
+  open_loop_harness harness(arrival_process(opt.kind, rate), opt.count);
+
+  boost::ptr_vector<inline_stage> stages;
+  for (size_t s = 0; s < opt.stages; ++s)
+    stages.push_back(new inline_stage(opt.workNanos));
+
+  graph_executor exec;
+  for (size_t s = 0; s + 1 < opt.stages; ++s)
+    exec.connect<0, 0>(stages[s], stages[s + 1]);
+  exec.sink(stages.back(), boost::function<void (const tuple_t &)>(
+    boost::bind(& complete_inline, & harness, _1)));
+  exec.prepare();
+
+  return harness.run(boost::bind(& inject_inline, & stages[0], & exec, _1));
+}
+
+//------------------------------------------------------------------------------
+load_result trial(const options & opt, double rate)
+{
+  load_result const result =
+    opt.threaded ? run_threaded(opt, rate) : run_inline(opt, rate);
+
+  std::cout << "rate " << result.offeredRate << "/s achieved "
+            << result.achievedRate << "/s completed " << result.completed
+            << "/" << result.sent << ": ";
+  result.latency.summary(std::cout);
+  std::cout << std::endl;
+  return result;
+}
+
+//==============================================================================
+int main(int argc, char * argv[])
+{
+  options opt;
+  for (int a = 1; a < argc; ++a)
+  {
+    std::string const arg = argv[a];
+    bool const more = (a + 1 < argc);
+    if ((arg == "--stages") && more)
+      opt.stages = std::max(1, std::atoi(argv[++a]));
+    else if ((arg == "--work-ns") && more)
+      opt.workNanos = unsigned(std::atoi(argv[++a]));
+    else if ((arg == "--count") && more)
+      opt.count = size_t(std::atol(argv[++a]));
+    else if ((arg == "--arrivals") && more)
+      opt.kind = std::strcmp(argv[++a], "constant") ?
+        arrival_process::poisson : arrival_process::constant;
+    else if ((arg == "--executor") && more)
+      opt.threaded = std::strcmp(argv[++a], "inline") != 0;
+    else if ((arg == "--rate") && more)
+      opt.rate = std::atof(argv[++a]);
+    else if ((arg == "--sweep") && (a + 3 < argc))
+    {
+      opt.rate = std::atof(argv[++a]);
+      opt.sweepMax = std::atof(argv[++a]);
+      opt.sweepFactor = std::atof(argv[++a]);
+    }
+    else if ((arg == "--slo-us") && more)
+      opt.sloMicros = unsigned(std::atoi(argv[++a]));
+    else
+    {
+      std::cerr << "unknown or incomplete option: " << arg << std::endl;
+      return 1;
+    }
+  }
+
+  std::cout << opt.stages << " stages, " << opt.workNanos << "ns/stage, "
+            << (opt.threaded ? "threaded" : "inline") << ", "
+            << (opt.kind == arrival_process::poisson ? "poisson" : "constant")
+            << " arrivals" << std::endl;
+
+  if (opt.sweepMax <= 0.0)
+  {
+    trial(opt, opt.rate);
+    return 0;
+  }
+
+  std::vector<sweep_point> const points = sweep_rates(
+    boost::bind(& trial, boost::cref(opt), _1), opt.rate, opt.sweepMax,
+    opt.sweepFactor, latency_histogram::value_t(opt.sloMicros) * 1000);
+
+  std::cout << "saturation point: " << saturation_rate(points)
+            << "/s (p99 SLO " << opt.sloMicros << "us)" << std::endl;
+  return 0;
+}
@@ -8,6 +8,7 @@
 
 #include "shared_proc_node.hpp"
 
+#include <boost/bind.hpp>
 #include <boost/thread.hpp>
 
 //==============================================================================
@@ -65,6 +66,8 @@ public:
   }
 
 protected:
+  typedef typename shared_proc_node<Derived_T, Input_T, Output_T>::mutex_t
+    mutex_t;
 
 private:
   /** Thread worker function.
@@ -88,7 +91,7 @@ template<typename Derived_T, typename Input_T, typename Output_T>
 active_proc_node<Derived_T, Input_T, Output_T>::
 active_proc_node(size_t maxQueueSize)
 :
-  shared_proc_node(maxQueueSize),
+  shared_proc_node<Derived_T, Input_T, Output_T>(maxQueueSize),
   m_startup(false),
   m_running(false),
   m_shutdown(false),
@@ -100,7 +103,7 @@ active_proc_node(size_t maxQueueSize)
 template<typename Derived_T, typename Input_T, typename Output_T>
 bool active_proc_node<Derived_T, Input_T, Output_T>::startup()
 {
-  mutex_t::scoped_lock l(this->mutex());
+  typename mutex_t::scoped_lock l(this->mutex());
   
   if (! m_startup)
   {
@@ -150,7 +153,7 @@ void active_proc_node<Derived_T, Input_T, Output_T>::join()
 template<typename Derived_T, typename Input_T, typename Output_T>
 bool active_proc_node<Derived_T, Input_T, Output_T>::running() const
 {
-  mutex_t::scoped_lock l(this->mutex());
+  typename mutex_t::scoped_lock l(this->mutex());
   return m_running;
 }
 
@@ -159,7 +162,7 @@ template<typename Derived_T, typename Input_T, typename Output_T>
 void active_proc_node<Derived_T, Input_T, Output_T>::run()
 {
   {
-    mutex_t::scoped_lock l(this->mutex());
+    typename mutex_t::scoped_lock l(this->mutex());
     m_running = true;
   }
 
@@ -167,7 +170,7 @@ void active_proc_node<Derived_T, Input_T, Output_T>::run()
   {
     while (! m_shutdown)
     {
-      mutex_t::scoped_lock l(this->mutex());
+      typename mutex_t::scoped_lock l(this->mutex());
 
       // TRICKY: We can't use the swap idiom here since the input queue is
       //   filled one component at a time.
@@ -191,7 +194,7 @@ void active_proc_node<Derived_T, Input_T, Output_T>::run()
     // Don't propagate, just let run() exit, which will shutdown the thread.
   }
 
-  mutex_t::scoped_lock l(this->mutex());
+  typename mutex_t::scoped_lock l(this->mutex());
   m_startup = false;
   m_running = false;
 }
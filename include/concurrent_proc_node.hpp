@@ -0,0 +1,224 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(CONCURRENT_PROC_NODE_HPP)
+#define CONCURRENT_PROC_NODE_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/fusion/include/as_vector.hpp>
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/mpl.hpp>
+#include <boost/fusion/include/value_at.hpp>
+#include <boost/lockfree/spsc_queue.hpp>
+#include <boost/mpl/assert.hpp>
+#include <boost/mpl/back_inserter.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/mpl/range_c.hpp>
+#include <boost/mpl/transform.hpp>
+#include <boost/mpl/vector.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/static_assert.hpp>
+#include <boost/type_traits/is_same.hpp>
+
+#include <algorithm>
+#include <stdexcept>
+
+//==============================================================================
+/** This object is a lock-free alternative to shared_proc_node for nodes
+ * whose input ports are fed by different threads.  Each input component has
+ * its own single-producer/single-consumer ring, so producers on different
+ * ports never wait on each other (or on the consumer).
+ *
+ * Readiness is tracked in one atomic word holding a small counter per port:
+ * a producer bumps its port's counter after pushing, and the consumer
+ * subtracts one from every counter after popping a complete input set.  A
+ * complete set is therefore detected with a single atomic load, and a whole
+ * set is retired with a single atomic subtraction.
+ *
+ * As with proc_node, we use CRTP.  Derived classes implement:
+ *   Output_T visit_impl();
+ * and read the input set being visited via input().
+ *
+ * TRICKY: Each port supports one producer thread, and visit() one consumer
+ * thread.  enqueue() never blocks; it returns false if the port is full.
+ */
+template<typename Derived_T, typename Input_T, typename Output_T>
+class concurrent_proc_node
+{
+public:
+  /** @param[in] maxQueueSize The capacity of each port's ring.  Clamped to
+   *    [1, maxPortCapacity()]; unbounded queues are not supported.  */
+  explicit concurrent_proc_node(size_t maxQueueSize = 1024);
+
+  ~concurrent_proc_node() {}
+
+  /** Enqueue the N-th input component.
+   * @param[in] component The input component to be processed.
+   * @return true if the input component was successfully enqueued for
+   *   processing, false if port N is full.
+   */
+  template<size_t N, typename InputComponent_T>
+  bool enqueue(const InputComponent_T & component)
+  {
+    typedef typename boost::fusion::result_of::value_at_c<Input_T, N>::type
+      InputComponent_t;
+    BOOST_MPL_ASSERT(( boost::is_same<InputComponent_t, InputComponent_T> ));
+
+    if (! boost::fusion::at_c<N>(m_ports)->push(component))
+      return false;
+
+    // Publish the component; pairs with the acquire load in is_ready().
+    m_counts.fetch_add(word_t(1) << (N * BITS), boost::memory_order_release);
+    return true;
+  }
+
+  /** @return The capacity of each port's ring. */
+  size_t maxQueueSize() const { return m_maxQueueSize; }
+
+  /** @return The number of complete input sets waiting to be visited. */
+  size_t queueSize() const;
+
+  /** @return true if a complete set of input values is ready for processing.
+   *   This is a single atomic load. */
+  bool is_ready() const
+  { return ! has_empty_port(m_counts.load(boost::memory_order_acquire)); }
+
+  /** @return the processed output value(s). */
+  Output_T visit();
+
+  /** @return The largest supported per-port capacity for this Input_T. */
+  static size_t maxPortCapacity() { return size_t(FIELD_MAX); }
+
+protected:
+  /** @return The input set being visited. */
+  const Input_T & input() const { return m_input; }
+
+private:
+  typedef boost::uint64_t word_t;
+
+  /** The cardinality of the input tuple. */
+  static size_t const CARDINALITY =
+    boost::fusion::result_of::size<Input_T>::type::value;
+  BOOST_STATIC_ASSERT(CARDINALITY > 0 && CARDINALITY <= 16);
+
+  /** Width of each port's counter in m_counts. */
+  static size_t const BITS = 64 / CARDINALITY;
+  /** A counter may briefly exceed its ring's capacity by one (the consumer
+   * pops before it subtracts), and must never reach its high bit. */
+  static word_t const FIELD_MAX = (word_t(1) << (BITS - 1)) - 2;
+
+  /** @return true if any port's counter in w is zero. */
+  static bool has_empty_port(word_t w)
+  { return (w - lows()) & ~w & (lows() << (BITS - 1)); }
+
+  /** @return A word with the lowest bit of every port's counter set. */
+  static word_t lows()
+  {
+    word_t w = 0;
+    for (size_t n = 0; n < CARDINALITY; ++n)
+      w |= word_t(1) << (n * BITS);
+    return w;
+  }
+
+  template<typename Component_T>
+  struct port_queue
+  {
+    typedef boost::shared_ptr<boost::lockfree::spsc_queue<Component_T> > type;
+  };
+
+  /** One ring per input component. */
+  typedef typename boost::fusion::result_of::as_vector<
+    typename boost::mpl::transform<
+      Input_T, port_queue<boost::mpl::_1>,
+      boost::mpl::back_inserter<boost::mpl::vector<> > >::type
+    >::type Ports_t;
+
+  typedef boost::mpl::range_c<size_t, 0, CARDINALITY> port_indices;
+
+  /** Allocates each port's ring. */
+  struct make_port
+  {
+    template<typename N_>
+    void operator()(N_) const
+    {
+      typedef typename boost::fusion::result_of::value_at_c<Input_T,
+        N_::value>::type component_t;
+      boost::fusion::at_c<N_::value>(node->m_ports).reset(
+        new boost::lockfree::spsc_queue<component_t>(node->m_maxQueueSize));
+    }
+
+    concurrent_proc_node * node;
+  };
+
+  /** Pops the front of each port's ring into m_input. */
+  struct pop_port
+  {
+    template<typename N_>
+    void operator()(N_) const
+    {
+      boost::fusion::at_c<N_::value>(node->m_ports)->pop(
+        boost::fusion::at_c<N_::value>(node->m_input));
+    }
+
+    concurrent_proc_node * node;
+  };
+
+  /** The capacity of each port's ring. */
+  size_t const m_maxQueueSize;
+  /** Per-port rings. */
+  Ports_t m_ports;
+  /** Per-port component counts, BITS bits each. */
+  boost::atomic<word_t> m_counts;
+  /** The input set being visited. */
+  Input_T m_input;
+};
+
+
+//==============================================================================
+template<typename Derived_T, typename Input_T, typename Output_T>
+concurrent_proc_node<Derived_T, Input_T, Output_T>::
+concurrent_proc_node(size_t maxQueueSize)
+:
+  m_maxQueueSize(std::max<size_t>(1,
+    std::min<size_t>(maxQueueSize, maxPortCapacity()))),
+  m_ports(),
+  m_counts(0),
+  m_input()
+{
+  make_port make = { this };
+  boost::mpl::for_each<port_indices>(make);
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+size_t concurrent_proc_node<Derived_T, Input_T, Output_T>::queueSize() const
+{
+  word_t const w = m_counts.load(boost::memory_order_acquire);
+  word_t const mask = ~word_t(0) >> (64 - BITS);
+
+  word_t ready = w & mask;
+  for (size_t n = 1; n < CARDINALITY; ++n)
+    ready = std::min(ready, (w >> (n * BITS)) & mask);
+  return size_t(ready);
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+Output_T concurrent_proc_node<Derived_T, Input_T, Output_T>::visit()
+{
+  if (! this->is_ready())
+    throw std::runtime_error("concurrent_proc_node not ready");
+
+  pop_port pop = { this };
+  boost::mpl::for_each<port_indices>(pop);
+
+  // Retire the set from every port at once.
+  m_counts.fetch_sub(lows(), boost::memory_order_relaxed);
+
+  return static_cast<Derived_T *>(this)->visit_impl();
+}
+
+#endif
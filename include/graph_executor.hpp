@@ -0,0 +1,670 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(GRAPH_EXECUTOR_HPP)
+#define GRAPH_EXECUTOR_HPP
+
+#include "proc_node.hpp"
+
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/recursive_mutex.hpp>
+
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+//==============================================================================
+/** This object drives a graph of proc_nodes to completion on the calling
+ * thread.  Nodes are registered with add(),
+ * and edges with connect<M, N>(), which routes output component M of one node
+ * to input component N of another.  prepare() computes a topological order
+ * and publishes it; run() then repeatedly sweeps that order, visiting every
+ * ready node and enqueueing its outputs downstream, until no node can make
+ * progress.
+ *
+ * A node is only visited when every downstream queue it feeds has room, so
+ * bounded queues (maxQueueSize) apply backpressure instead of losing outputs.
+ *
+ * The graph may be reconfigured while it runs.  add(), connect(), sink(),
+ * disconnect(), remove() and replace() only edit a staged copy of the graph,
+ * and may be called from any thread.  prepare() publishes the staged graph as
+ * an immutable snapshot tagged with a new epoch.  Each run() holds the newest
+ * snapshot for its whole pass, so tuples already in flight finish on the
+ * topology they started on, and the next run() picks up the new one; nothing
+ * is stopped or drained.  The first run() on a snapshot that replaced a node
+ * moves whatever is still queued in the original node, including partially
+ * filled input sets, into its replacement.  Once wait_for_epoch() returns, no
+ * run() still references a node that was removed or replaced before that
+ * epoch.
+ *
+ * For convenience run() publishes pending edits itself, unless another thread
+ * holds an edit_scope, which groups several edits into one epoch.
+ *
+ * run() takes no locks and touches no reference counts while the graph is
+ * unchanged: it pins the newest snapshot by publishing its epoch in an
+ * atomic.  Only the first run() after a prepare() locks, to publish edits,
+ * hand off inputs and delete retired snapshots.
+ *
+ * NOTE: Nodes are driven through their proc_node base, so any locking done by
+ * derived node classes (e.g. shared_proc_node) is bypassed.  Every node in the
+ * graph must be driven only by this executor's thread, and only one thread
+ * may call run().
+ * TRICKY: Registered nodes must outlive the executor, or, if removed or
+ * replaced, the epoch that removed them.  remove() does not drain the node;
+ * inputs it still holds once the older runs finish are left in its queue.
+ * Inputs enqueued directly to a replaced node after its inputs were handed
+ * off are likewise left behind.
+ */
+class graph_executor
+{
+public:
+  /** Holds edits back from run(), so that edits made from another thread
+   * are published together by one prepare(). */
+  class edit_scope
+  {
+  public:
+    explicit edit_scope(graph_executor & exec) : m_lock(exec.m_editMutex) {}
+
+  private:
+    boost::recursive_mutex::scoped_lock m_lock;
+  };
+
+  graph_executor()
+  :
+    m_editMutex(), m_staged(), m_stagedHandoffs(), m_pending(false),
+    m_epoch(0), m_current(0), m_running(0), m_waiters(0), m_epochMutex(),
+    m_epochDone(), m_retired(), m_handoffs(), m_cleanupPending(false)
+  {}
+
+  ~graph_executor();
+
+  /** Register a node.  Registering a node twice has no effect. */
+  template<typename Derived_T, typename Input_T, typename Output_T>
+  void add(proc_node<Derived_T, Input_T, Output_T> & node)
+  {
+    boost::recursive_mutex::scoped_lock l(m_editMutex);
+    this->vertex_of(node);
+  }
+
+  /** Route output component M of source to input component N of target,
+   * registering both nodes if necessary.  */
+  template<size_t M, size_t N,
+           typename SourceDerived_T, typename SourceInput_T,
+           typename SourceOutput_T,
+           typename TargetDerived_T, typename TargetInput_T,
+           typename TargetOutput_T>
+  void connect(
+    proc_node<SourceDerived_T, SourceInput_T, SourceOutput_T> & source,
+    proc_node<TargetDerived_T, TargetInput_T, TargetOutput_T> & target)
+  {
+    typedef proc_node<TargetDerived_T, TargetInput_T, TargetOutput_T> target_t;
+
+    boost::recursive_mutex::scoped_lock l(m_editMutex);
+    node_vertex<SourceDerived_T, SourceInput_T, SourceOutput_T> & from =
+      this->vertex_of(source);
+    this->vertex_of(target);
+
+    edge<SourceOutput_T> e;
+    e.target = & target;
+    e.from = M;
+    e.to = N;
+    e.has_room = & graph_executor::has_room<N, target_t>;
+    e.forward = & graph_executor::forward<M, N, SourceOutput_T, target_t>;
+    from.edges.push_back(e);
+  }
+
+  /** Pass every output of node to sink, registering the node if
+   * necessary.  */
+  template<typename Derived_T, typename Input_T, typename Output_T>
+  void sink(proc_node<Derived_T, Input_T, Output_T> & node,
+            const boost::function<void (const Output_T &)> & sink)
+  {
+    boost::recursive_mutex::scoped_lock l(m_editMutex);
+    edge<Output_T> e;
+    e.target = 0;
+    e.from = 0;
+    e.to = 0;
+    e.has_room = 0;
+    e.forward = 0;
+    e.sink = sink;
+    this->vertex_of(node).edges.push_back(e);
+  }
+
+  /** Remove the routes from output component M of source to input component
+   * N of target.
+   * @return The number of edges removed. */
+  template<size_t M, size_t N,
+           typename SourceDerived_T, typename SourceInput_T,
+           typename SourceOutput_T,
+           typename TargetDerived_T, typename TargetInput_T,
+           typename TargetOutput_T>
+  size_t disconnect(
+    proc_node<SourceDerived_T, SourceInput_T, SourceOutput_T> & source,
+    proc_node<TargetDerived_T, TargetInput_T, TargetOutput_T> & target)
+  {
+    boost::recursive_mutex::scoped_lock l(m_editMutex);
+    vertices_t::iterator const i = m_staged.find(& source);
+    if (i == m_staged.end())
+      return 0;
+
+    size_t const erased = i->second->erase_edges(& target, M, N);
+    if (erased)
+      m_pending = true;
+    return erased;
+  }
+
+  /** Unregister node, along with its sinks and every edge into or out of it.
+   * @return false if node was not registered. */
+  template<typename Derived_T, typename Input_T, typename Output_T>
+  bool remove(proc_node<Derived_T, Input_T, Output_T> & node)
+  {
+    boost::recursive_mutex::scoped_lock l(m_editMutex);
+    if (! m_staged.erase(& node))
+      return false;
+
+    for (vertices_t::iterator i = m_staged.begin(); i != m_staged.end(); ++i)
+      i->second->erase_edges(& node, ANY, ANY);
+    m_pending = true;
+    return true;
+  }
+
+  /** Swap replacement in for original: replacement takes over every edge
+   * and sink of original, which is unregistered.  replacement must not
+   * already be registered.  The first run() on the published graph moves
+   * the inputs still queued in original to the front of replacement's queue
+   * (see proc_node::take_inputs()).
+   * @throw std::invalid_argument if original is not registered or
+   *   replacement is.
+   */
+  template<typename Derived_T, typename Input_T, typename Output_T>
+  void replace(proc_node<Derived_T, Input_T, Output_T> & original,
+               proc_node<Derived_T, Input_T, Output_T> & replacement)
+  {
+    typedef node_vertex<Derived_T, Input_T, Output_T> vertex_t;
+
+    boost::recursive_mutex::scoped_lock l(m_editMutex);
+    vertices_t::iterator const i = m_staged.find(& original);
+    if ((i == m_staged.end()) || m_staged.count(& replacement))
+      throw std::invalid_argument("graph_executor cannot replace node");
+
+    vertex_t * const v = new vertex_t(static_cast<const vertex_t &>(*i->second));
+    v->node = & replacement;
+    m_staged.erase(i);
+    m_staged[& replacement] = boost::shared_ptr<vertex>(v);
+
+    for (vertices_t::iterator j = m_staged.begin(); j != m_staged.end(); ++j)
+      j->second->retarget(& original, & replacement);
+
+    handoff h;
+    h.epoch = 0;
+    h.from = & original;
+    h.to = & replacement;
+    h.move = & graph_executor::take_inputs<proc_node<Derived_T, Input_T,
+                                                     Output_T> >;
+    m_stagedHandoffs.push_back(h);
+    m_pending = true;
+  }
+
+  /** Compute the topological visit order of the staged graph and publish it.
+   * Called by run() after the graph has changed.
+   * @return The epoch of the published graph.
+   * @throw std::runtime_error if the graph has a cycle.  Nothing is published.
+   */
+  size_t prepare();
+
+  /** Visit ready nodes of the newest published graph until none can make
+   * progress.
+   * @return The number of visits made.
+   */
+  size_t run();
+
+  /** @return The epoch of the newest published graph; 0 if none. */
+  size_t epoch() const { return m_epoch.load(boost::memory_order_acquire); }
+
+  /** Block until no run() is using a graph older than epoch, and the inputs
+   * of nodes replaced up to epoch have been handed off.  The hand-off happens
+   * at the start of the next run(), so another thread must keep calling
+   * run().
+   * @param[in] epoch A published epoch, as returned by prepare(). */
+  void wait_for_epoch(size_t epoch);
+
+  /** @return The number of registered nodes in the staged graph. */
+  size_t size() const
+  {
+    boost::recursive_mutex::scoped_lock l(m_editMutex);
+    return m_staged.size();
+  }
+
+private:
+  /** Matches any component index in erase_edges(). */
+  static size_t const ANY = size_t(-1);
+
+  /** Type-erased node. */
+  struct vertex
+  {
+    virtual ~vertex() {}
+
+    /** @return A copy, to be published in a snapshot. */
+    virtual vertex * clone() const = 0;
+
+    /** @return the addresses of the nodes this node feeds. */
+    virtual std::vector<const void *> targets() const = 0;
+
+    /** Visit the node and forward its outputs as long as it is ready and
+     * every downstream queue has room.
+     * @return The number of visits made. */
+    virtual size_t drain() const = 0;
+
+    /** Remove the edges from output component from to input component to of
+     * target.
+     * @return The number of edges removed. */
+    virtual size_t erase_edges(const void * target, size_t from,
+                               size_t to) = 0;
+
+    /** Point the edges into original at replacement instead. */
+    virtual void retarget(const void * original, void * replacement) = 0;
+  };
+
+  /** One route out of a node: either into another node, or to a sink. */
+  template<typename Output_T>
+  struct edge
+  {
+    /** The target node, as its proc_node base; 0 for a sink. */
+    void * target;
+    /** The output and input component indices. */
+    size_t from;
+    size_t to;
+    bool (* has_room)(void *);
+    void (* forward)(void *, const Output_T &);
+    boost::function<void (const Output_T &)> sink;
+  };
+
+  template<typename Derived_T, typename Input_T, typename Output_T>
+  struct node_vertex : vertex
+  {
+    typedef proc_node<Derived_T, Input_T, Output_T> node_t;
+
+    explicit node_vertex(node_t & n) : node(& n), edges() {}
+
+    vertex * clone() const { return new node_vertex(*this); }
+
+    std::vector<const void *> targets() const
+    {
+      std::vector<const void *> targets;
+      for (size_t e = 0; e < edges.size(); ++e)
+      {
+        if (edges[e].target)
+          targets.push_back(edges[e].target);
+      }
+      return targets;
+    }
+
+    size_t drain() const
+    {
+      size_t visits = 0;
+      while (node->is_ready() && this->has_room())
+      {
+        Output_T const output = node->visit();
+        for (size_t e = 0; e < edges.size(); ++e)
+        {
+          if (edges[e].target)
+            edges[e].forward(edges[e].target, output);
+          else
+            edges[e].sink(output);
+        }
+        ++visits;
+      }
+      return visits;
+    }
+
+    bool has_room() const
+    {
+      for (size_t e = 0; e < edges.size(); ++e)
+      {
+        if (edges[e].target && ! edges[e].has_room(edges[e].target))
+          return false;
+      }
+      return true;
+    }
+
+    size_t erase_edges(const void * target, size_t from, size_t to)
+    {
+      size_t const before = edges.size();
+      for (size_t e = edges.size(); e-- > 0; )
+      {
+        if ((edges[e].target == target) &&
+            ((from == ANY) || (edges[e].from == from)) &&
+            ((to == ANY) || (edges[e].to == to)))
+          edges.erase(edges.begin() + e);
+      }
+      return before - edges.size();
+    }
+
+    void retarget(const void * original, void * replacement)
+    {
+      for (size_t e = 0; e < edges.size(); ++e)
+      {
+        if (edges[e].target == original)
+          edges[e].target = replacement;
+      }
+    }
+
+    node_t * node;
+    std::vector<edge<Output_T> > edges;
+  };
+
+  /** A published, immutable graph. */
+  struct topology
+  {
+    /** Vertices in topological order. */
+    std::vector<boost::shared_ptr<const vertex> > order;
+    size_t epoch;
+  };
+
+  /** Publishes the epoch a run() is using for the lifetime of this object,
+   * so that wait_for_epoch() can tell when older graphs are out of use. */
+  class epoch_pin
+  {
+  public:
+    explicit epoch_pin(graph_executor & exec) : m_exec(exec) {}
+    ~epoch_pin();
+
+    /** Pin the newest snapshot.
+     * @return The snapshot, or 0 if none has been published. */
+    const topology * pin();
+
+  private:
+    graph_executor & m_exec;
+  };
+
+  /** Moves the inputs of a replaced node into its replacement. */
+  struct handoff
+  {
+    /** The epoch that replaced from. */
+    size_t epoch;
+    void * from;
+    void * to;
+    void (* move)(void *, void *);
+  };
+
+  typedef std::map<const void *, boost::shared_ptr<vertex> > vertices_t;
+
+  template<size_t N, typename Node_T>
+  static bool has_room(void * node)
+  { return ! static_cast<Node_T *>(node)->full(N); }
+
+  template<size_t M, size_t N, typename Output_T, typename Node_T>
+  static void forward(void * node, const Output_T & output)
+  {
+    static_cast<Node_T *>(node)->template enqueue<N>(
+      boost::fusion::at_c<M>(output));
+  }
+
+  template<typename Node_T>
+  static void take_inputs(void * from, void * to)
+  { static_cast<Node_T *>(to)->take_inputs(*static_cast<Node_T *>(from)); }
+
+  /** Perform the hand-offs of epochs up to t's, and delete every retired
+   * snapshot but t.  Called by run(). */
+  void clean_up(const topology * t);
+
+  /** @return The staged vertex for node, creating it if necessary.  The
+   *   caller holds m_editMutex. */
+  template<typename Derived_T, typename Input_T, typename Output_T>
+  node_vertex<Derived_T, Input_T, Output_T> &
+  vertex_of(proc_node<Derived_T, Input_T, Output_T> & node)
+  {
+    typedef node_vertex<Derived_T, Input_T, Output_T> vertex_t;
+
+    m_pending = true;
+    boost::shared_ptr<vertex> & v = m_staged[& node];
+    if (! v)
+      v.reset(new vertex_t(node));
+    return static_cast<vertex_t &>(*v);
+  }
+
+  /** Guards m_staged.  Recursive so an edit_scope can wrap the edits. */
+  mutable boost::recursive_mutex m_editMutex;
+  /** The graph being edited, keyed by node address.  Never published;
+   * prepare() publishes copies of its vertices. */
+  vertices_t m_staged;
+  /** Hand-offs for replace() calls not yet published. */
+  std::vector<handoff> m_stagedHandoffs;
+  /** true indicates m_staged has edits not yet published. */
+  boost::atomic<bool> m_pending;
+  /** The epoch of m_current. */
+  boost::atomic<size_t> m_epoch;
+  /** The newest published graph.
+   * TRICKY: Only run() reads snapshots, and only run() deletes them (see
+   * clean_up()), so a snapshot it has loaded stays valid without a
+   * reference count. */
+  boost::atomic<const topology *> m_current;
+  /** The epoch of the graph the current run() is using; 0 between runs. */
+  boost::atomic<size_t> m_running;
+  /** The number of threads in wait_for_epoch(). */
+  boost::atomic<size_t> m_waiters;
+  /** Guards m_retired and m_handoffs. */
+  boost::mutex m_epochMutex;
+  /** Signalled when a run() ends or hand-offs are done. */
+  boost::condition_variable m_epochDone;
+  /** Snapshots replaced by a newer one, not yet deleted. */
+  std::vector<const topology *> m_retired;
+  /** Published hand-offs not yet performed. */
+  std::vector<handoff> m_handoffs;
+  /** true indicates m_retired or m_handoffs is not empty. */
+  boost::atomic<bool> m_cleanupPending;
+};
+
+
+//==============================================================================
+inline graph_executor::~graph_executor()
+{
+  delete m_current.load();
+  for (size_t r = 0; r < m_retired.size(); ++r)
+    delete m_retired[r];
+}
+
+//------------------------------------------------------------------------------
+inline size_t graph_executor::prepare()
+{
+  boost::recursive_mutex::scoped_lock l(m_editMutex);
+
+  // Kahn's algorithm.
+  std::map<const void *, size_t> inDegree;
+  for (vertices_t::const_iterator i = m_staged.begin(); i != m_staged.end();
+       ++i)
+  {
+    inDegree[i->first];
+    std::vector<const void *> const targets = i->second->targets();
+    for (size_t t = 0; t < targets.size(); ++t)
+      ++inDegree[targets[t]];
+  }
+
+  std::vector<const void *> order;
+  order.reserve(m_staged.size());
+  for (std::map<const void *, size_t>::const_iterator i = inDegree.begin();
+       i != inDegree.end(); ++i)
+  {
+    if (! i->second)
+      order.push_back(i->first);
+  }
+
+  for (size_t o = 0; o < order.size(); ++o)
+  {
+    std::vector<const void *> const next =
+      m_staged.find(order[o])->second->targets();
+    for (size_t t = 0; t < next.size(); ++t)
+    {
+      if (! --inDegree[next[t]])
+        order.push_back(next[t]);
+    }
+  }
+
+  if (order.size() != m_staged.size())
+    throw std::runtime_error("graph_executor graph has a cycle");
+
+  // Later edits to m_staged must not show through, so publish copies.
+  std::vector<boost::shared_ptr<const vertex> > vertices;
+  vertices.reserve(order.size());
+  for (size_t o = 0; o < order.size(); ++o)
+  {
+    vertices.push_back(boost::shared_ptr<const vertex>(
+      m_staged.find(order[o])->second->clone()));
+  }
+
+  size_t const epoch = m_epoch.load() + 1;
+  topology * const t = new topology;
+  t->order.swap(vertices);
+  t->epoch = epoch;
+
+  {
+    boost::mutex::scoped_lock e(m_epochMutex);
+    if (const topology * const previous = m_current.load())
+      m_retired.push_back(previous);
+    for (size_t h = 0; h < m_stagedHandoffs.size(); ++h)
+    {
+      m_handoffs.push_back(m_stagedHandoffs[h]);
+      m_handoffs.back().epoch = epoch;
+    }
+    m_cleanupPending = ! m_retired.empty() || ! m_handoffs.empty();
+    m_current.store(t);
+  }
+  m_stagedHandoffs.clear();
+
+  m_epoch.store(epoch, boost::memory_order_release);
+  m_pending = false;
+  return epoch;
+}
+
+//------------------------------------------------------------------------------
+inline size_t graph_executor::run()
+{
+  if (m_pending.load(boost::memory_order_acquire))
+  {
+    // Leave edits alone while an edit_scope is open on another thread.
+    boost::recursive_mutex::scoped_try_lock l(m_editMutex);
+    if (l.owns_lock() && m_pending)
+      this->prepare();
+  }
+
+  epoch_pin pin(*this);
+  const topology * const t = pin.pin();
+  if (! t)
+    return 0;
+
+  // Only one thread calls run(), so no run() is using an older graph: the
+  // inputs of replaced nodes can be moved, and older snapshots deleted.
+  if (m_cleanupPending.load(boost::memory_order_acquire))
+    this->clean_up(t);
+
+  // In a DAG with unbounded queues one sweep suffices; further sweeps are
+  // only needed when a full downstream queue held a node back.
+  size_t total = 0;
+  for (;;)
+  {
+    size_t visits = 0;
+    for (size_t o = 0; o < t->order.size(); ++o)
+      visits += t->order[o]->drain();
+
+    if (! visits)
+      return total;
+    total += visits;
+  }
+}
+
+//------------------------------------------------------------------------------
+inline void graph_executor::wait_for_epoch(size_t epoch)
+{
+  // The current graph is never retired, so don't wait past it.
+  epoch = std::min(epoch, m_epoch.load(boost::memory_order_acquire));
+
+  // TRICKY: Register before checking m_running, so that a run() ending
+  // after the check sees us and notifies (see ~epoch_pin()).
+  ++m_waiters;
+  {
+    boost::mutex::scoped_lock l(m_epochMutex);
+    for (;;)
+    {
+      size_t const running = m_running.load();
+      bool busy = running && (running < epoch);
+      for (size_t h = 0; ! busy && (h < m_handoffs.size()); ++h)
+        busy = (m_handoffs[h].epoch <= epoch);
+
+      if (! busy)
+        break;
+      m_epochDone.wait(l);
+    }
+  }
+  --m_waiters;
+}
+
+//------------------------------------------------------------------------------
+inline void graph_executor::clean_up(const topology * t)
+{
+  boost::mutex::scoped_lock l(m_epochMutex);
+
+  // In publication order, so chained replacements end up in the last node.
+  std::vector<handoff> later;
+  for (size_t h = 0; h < m_handoffs.size(); ++h)
+  {
+    if (m_handoffs[h].epoch <= t->epoch)
+      m_handoffs[h].move(m_handoffs[h].from, m_handoffs[h].to);
+    else
+      later.push_back(m_handoffs[h]);
+  }
+  m_handoffs.swap(later);
+
+  // t may itself have been replaced since this run() pinned it.
+  std::vector<const topology *> kept;
+  for (size_t r = 0; r < m_retired.size(); ++r)
+  {
+    if (m_retired[r] == t)
+      kept.push_back(t);
+    else
+      delete m_retired[r];
+  }
+  m_retired.swap(kept);
+
+  m_cleanupPending = ! m_retired.empty() || ! m_handoffs.empty();
+  m_epochDone.notify_all();
+}
+
+//------------------------------------------------------------------------------
+inline const graph_executor::topology * graph_executor::epoch_pin::pin()
+{
+  // TRICKY: A prepare() between the load and the pin would let
+  // wait_for_epoch() miss this run, so pin again until the pinned snapshot
+  // is still the newest.  Every access is sequentially consistent, so a
+  // waiter that saw the newer epoch published also sees this pin.
+  const topology * t = m_exec.m_current.load();
+  while (t)
+  {
+    m_exec.m_running.store(t->epoch);
+    const topology * const current = m_exec.m_current.load();
+    if (current == t)
+      break;
+    t = current;
+  }
+  return t;
+}
+
+//------------------------------------------------------------------------------
+inline graph_executor::epoch_pin::~epoch_pin()
+{
+  m_exec.m_running.store(0);
+  if (m_exec.m_waiters.load())
+  {
+    boost::mutex::scoped_lock l(m_exec.m_epochMutex);
+    m_exec.m_epochDone.notify_all();
+  }
+}
+
+#endif
@@ -0,0 +1,485 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(LATENCY_HARNESS_HPP)
+#define LATENCY_HARNESS_HPP
+
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/random/exponential_distribution.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+//==============================================================================
+/** This object is a log-linear (HDR style) histogram of non-negative integer
+ * values, e.g. latencies in nanoseconds.  Values below 2^subBucketBits are
+ * recorded exactly; larger values are recorded with a relative error of at
+ * most 2^-(subBucketBits - 1), at a fixed memory cost independent of the
+ * number of samples.
+ */
+class latency_histogram
+{
+public:
+  typedef boost::uint64_t value_t;
+
+  /** @param[in] subBucketBits log2 of the number of linear sub-buckets per
+   *    power of two; 11 gives three significant decimal digits.
+   * @param[in] highestTrackable Larger values are clamped to this.  */
+  explicit latency_histogram(unsigned subBucketBits = 11,
+                             value_t highestTrackable = value_t(1) << 40)
+  :
+    m_subBucketBits(std::max(subBucketBits, 2u)),
+    m_subBucketCount(value_t(1) << m_subBucketBits),
+    m_highest(std::max(highestTrackable, m_subBucketCount)),
+    m_counts(this->index_of(m_highest) + 1, 0),
+    m_total(0),
+    m_min(std::numeric_limits<value_t>::max()),
+    m_max(0),
+    m_sum(0.0)
+  {}
+
+  /** Record count occurrences of value. */
+  void record(value_t value, value_t count = 1)
+  {
+    value = std::min(value, m_highest);
+    m_counts[this->index_of(value)] += count;
+    m_total += count;
+    m_min = std::min(m_min, value);
+    m_max = std::max(m_max, value);
+    m_sum += double(value) * count;
+  }
+
+  /** Add every sample of other (which must have the same layout). */
+  void merge(const latency_histogram & other)
+  {
+    if (other.m_counts.size() != m_counts.size())
+      throw std::runtime_error("latency_histogram layouts differ");
+
+    for (size_t i = 0; i < m_counts.size(); ++i)
+      m_counts[i] += other.m_counts[i];
+    m_total += other.m_total;
+    m_min = std::min(m_min, other.m_min);
+    m_max = std::max(m_max, other.m_max);
+    m_sum += other.m_sum;
+  }
+
+  void reset()
+  {
+    std::fill(m_counts.begin(), m_counts.end(), value_t(0));
+    m_total = 0;
+    m_min = std::numeric_limits<value_t>::max();
+    m_max = 0;
+    m_sum = 0.0;
+  }
+
+  /** @return The number of recorded samples. */
+  value_t count() const { return m_total; }
+
+  value_t min() const { return m_total ? m_min : 0; }
+  value_t max() const { return m_max; }
+  double mean() const { return m_total ? m_sum / m_total : 0.0; }
+
+  /** @param[in] percentile In [0, 100].
+   * @return The smallest recorded value (to the histogram's precision) that
+   *   is greater than or equal to percentile percent of the samples. */
+  value_t percentile(double percentile) const;
+
+  /** Write a one-line percentile summary, in microseconds, assuming values
+   * are nanoseconds. */
+  void summary(std::ostream & os) const;
+
+private:
+  /** @return The counts slot for value. */
+  size_t index_of(value_t value) const
+  {
+    if (value < m_subBucketCount)
+      return size_t(value);
+
+    // Shift value down into [half, count) and note how far it went.
+    unsigned shift = 0;
+    while ((value >> shift) >= m_subBucketCount)
+      ++shift;
+
+    value_t const half = m_subBucketCount / 2;
+    return size_t(m_subBucketCount + (shift - 1) * half +
+                  ((value >> shift) - half));
+  }
+
+  /** @return The largest value that maps to slot index. */
+  value_t highest_in(size_t index) const
+  {
+    if (index < m_subBucketCount)
+      return value_t(index);
+
+    value_t const half = m_subBucketCount / 2;
+    value_t const j = index - m_subBucketCount;
+    unsigned const shift = unsigned(j / half) + 1;
+    value_t const sub = j % half + half;
+    return ((sub + 1) << shift) - 1;
+  }
+
+  unsigned m_subBucketBits;
+  value_t m_subBucketCount;
+  value_t m_highest;
+  std::vector<value_t> m_counts;
+  value_t m_total;
+  value_t m_min;
+  value_t m_max;
+  double m_sum;
+};
+
+//==============================================================================
+/** This object generates the gaps between arrivals of an open-loop load at a
+ * fixed mean rate, either evenly spaced or as a Poisson process. */
+class arrival_process
+{
+public:
+  enum kind_t { constant, poisson };
+
+  /** @param[in] kind The arrival distribution.
+   * @param[in] ratePerSecond The mean arrival rate.
+   * @param[in] seed Random seed (poisson only). */
+  arrival_process(kind_t kind, double ratePerSecond, unsigned seed = 5489u)
+  :
+    m_kind(kind),
+    m_meanNanos(1e9 / ratePerSecond),
+    m_random(seed),
+    m_exponential(1.0)
+  {
+    if (! (ratePerSecond > 0.0))
+      throw std::runtime_error("arrival_process rate must be positive");
+  }
+
+  /** @return The time until the next arrival, in nanoseconds. */
+  double next_interval()
+  {
+    if (m_kind == constant)
+      return m_meanNanos;
+    return m_exponential(m_random) * m_meanNanos;
+  }
+
+  /** @return The mean time between arrivals, in nanoseconds. */
+  double mean_interval() const { return m_meanNanos; }
+
+private:
+  kind_t m_kind;
+  double m_meanNanos;
+  boost::random::mt19937 m_random;
+  boost::random::exponential_distribution<double> m_exponential;
+};
+
+//==============================================================================
+/** The outcome of one open-loop run. */
+struct load_result
+{
+  load_result()
+  : offeredRate(0.0), achievedRate(0.0), sent(0), completed(0), stale(0),
+    duplicates(0), latency()
+  {}
+
+  /** Arrivals per second requested, and completions per second achieved. */
+  double offeredRate;
+  double achievedRate;
+  size_t sent;
+  size_t completed;
+  /** Completions ignored during the run because their ids belonged to an
+   * earlier run, or were never sent. */
+  size_t stale;
+  /** Completions ignored because their tuple had already completed, e.g. at
+   * another sink of a graph that fans out. */
+  size_t duplicates;
+  /** End-to-end latency in nanoseconds, measured from each tuple's
+   * *intended* arrival time. */
+  latency_histogram latency;
+};
+
+//==============================================================================
+/** This object drives a graph with an open-loop load: tuples are injected on
+ * a precomputed schedule regardless of how fast the graph drains them, and
+ * each tuple's latency is measured from when it was *scheduled* to arrive
+ * rather than when inject() got around to sending it.  A graph that stalls or
+ * pushes back on the injector is therefore charged for the delay it imposes
+ * on every queued arrival, which corrects for coordinated omission.
+ *
+ * The caller supplies inject(id), which feeds tuple id into the graph, and
+ * arranges for the graph's sink to call complete(id) (from any thread).  A
+ * tuple completes the first time complete() is called with its id, so in a
+ * graph with several sinks its latency is measured to the first one.
+ * Each run() uses a fresh range of ids, so stragglers from a run that timed
+ * out are not charged to a later run.
+ */
+class open_loop_harness
+{
+public:
+  typedef boost::chrono::steady_clock clock_t;
+
+  /** @param[in] arrivals The arrival schedule generator.
+   * @param[in] count The number of tuples to send per run. */
+  open_loop_harness(const arrival_process & arrivals, size_t count)
+  :
+    m_arrivals(arrivals),
+    m_count(count),
+    m_mutex(),
+    m_done(),
+    m_start(),
+    m_firstId(0),
+    m_running(false),
+    m_intended(),
+    m_completed(),
+    m_last(),
+    m_result()
+  {}
+
+  /** Send count tuples on schedule, then wait for them to complete.
+   * @param[in] inject Called on the calling thread with ids
+   *   first..first+count-1, where first is count times the number of
+   *   earlier runs.
+   * @param[in] drainTimeoutMillis How long to wait for stragglers after the
+   *   last tuple has been sent.
+   * @return The measured latency distribution and rates. */
+  load_result run(const boost::function<void (size_t)> & inject,
+                  unsigned drainTimeoutMillis = 1000);
+
+  /** Record the completion of tuple id.  Ids that do not belong to the
+   * current run, repeated completions of a tuple, and completions after run()
+   * has returned, are ignored.  Thread-safe. */
+  void complete(size_t id);
+
+private:
+  static boost::int64_t since(clock_t::time_point start)
+  {
+    return boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+      clock_t::now() - start).count();
+  }
+
+  arrival_process m_arrivals;
+  size_t m_count;
+
+  /** Mutex for synchronizing access to the result. */
+  boost::mutex m_mutex;
+  boost::condition_variable m_done;
+  clock_t::time_point m_start;
+  /** The id of the current run's first tuple. */
+  size_t m_firstId;
+  /** true while run() is collecting completions. */
+  bool m_running;
+  /** Intended arrival time of each tuple, in nanoseconds since m_start. */
+  std::vector<boost::int64_t> m_intended;
+  /** true for each tuple that has completed. */
+  std::vector<bool> m_completed;
+  /** Time of the last completion, in nanoseconds since m_start. */
+  boost::int64_t m_last;
+  load_result m_result;
+};
+
+//==============================================================================
+/** One point of a rate sweep. */
+struct sweep_point
+{
+  double offeredRate;
+  double achievedRate;
+  latency_histogram::value_t p50;
+  latency_histogram::value_t p99;
+  latency_histogram::value_t p999;
+  latency_histogram::value_t max;
+  /** true if the graph could not keep up at this rate. */
+  bool saturated;
+};
+
+/** Run trial at geometrically increasing rates until the graph saturates:
+ * it completes less than 95% of the offered rate, or its p99 latency exceeds
+ * p99LimitNanos.
+ * @param[in] trial Runs one open-loop load at the given rate.
+ * @return Every point measured; the last one is saturated unless maxRate was
+ *   reached first. */
+inline std::vector<sweep_point> sweep_rates(
+  const boost::function<load_result (double)> & trial,
+  double startRate, double maxRate, double factor,
+  latency_histogram::value_t p99LimitNanos)
+{
+  std::vector<sweep_point> points;
+  for (double rate = startRate; rate <= maxRate; rate *= factor)
+  {
+    load_result const r = trial(rate);
+
+    sweep_point p;
+    p.offeredRate = r.offeredRate;
+    p.achievedRate = r.achievedRate;
+    p.p50 = r.latency.percentile(50.0);
+    p.p99 = r.latency.percentile(99.0);
+    p.p999 = r.latency.percentile(99.9);
+    p.max = r.latency.max();
+    p.saturated = (r.completed < r.sent) ||
+      (r.achievedRate < 0.95 * r.offeredRate) || (p.p99 > p99LimitNanos);
+    points.push_back(p);
+
+    if (p.saturated || (factor <= 1.0))
+      break;
+  }
+  return points;
+}
+
+/** @return The highest offered rate in points that was not saturated, or 0
+ *   if there is none. */
+inline double saturation_rate(const std::vector<sweep_point> & points)
+{
+  double rate = 0.0;
+  for (size_t n = 0; n < points.size(); ++n)
+  {
+    if (! points[n].saturated)
+      rate = std::max(rate, points[n].offeredRate);
+  }
+  return rate;
+}
+
+
+//==============================================================================
+inline latency_histogram::value_t
+latency_histogram::percentile(double percentile) const
+{
+  if (! m_total)
+    return 0;
+
+  double const fraction = std::min(std::max(percentile, 0.0), 100.0) / 100.0;
+  value_t const target = std::max<value_t>(1,
+    value_t(fraction * double(m_total) + 0.5));
+
+  value_t seen = 0;
+  for (size_t i = 0; i < m_counts.size(); ++i)
+  {
+    seen += m_counts[i];
+    if (seen >= target)
+      return std::min(this->highest_in(i), m_max);
+  }
+  return m_max;
+}
+
+//------------------------------------------------------------------------------
+inline void latency_histogram::summary(std::ostream & os) const
+{
+  std::ios_base::fmtflags const flags = os.flags();
+  std::streamsize const precision = os.precision();
+
+  os << std::fixed << std::setprecision(1)
+     << "n=" << m_total
+     << " mean=" << this->mean() / 1e3
+     << " p50=" << this->percentile(50.0) / 1e3
+     << " p90=" << this->percentile(90.0) / 1e3
+     << " p99=" << this->percentile(99.0) / 1e3
+     << " p99.9=" << this->percentile(99.9) / 1e3
+     << " max=" << this->max() / 1e3 << " (us)";
+
+  os.flags(flags);
+  os.precision(precision);
+}
+
+//------------------------------------------------------------------------------
+inline load_result open_loop_harness::run(
+  const boost::function<void (size_t)> & inject, unsigned drainTimeoutMillis)
+{
+  // Precompute the schedule so generating it costs nothing while sending.
+  std::vector<boost::int64_t> intended(m_count);
+  double t = 0.0;
+  for (size_t id = 0; id < m_count; ++id)
+  {
+    t += m_arrivals.next_interval();
+    intended[id] = boost::int64_t(t);
+  }
+
+  size_t firstId;
+  clock_t::time_point start;
+  {
+    boost::mutex::scoped_lock l(m_mutex);
+    if (m_running)
+      throw std::logic_error("open_loop_harness is already running");
+
+    m_intended.swap(intended);
+    m_completed.assign(m_count, false);
+    m_result = load_result();
+    m_result.offeredRate = 1e9 / m_arrivals.mean_interval();
+    m_last = 0;
+    m_start = start = clock_t::now();
+    firstId = m_firstId;
+    m_running = true;
+  }
+
+  for (size_t n = 0; n < m_count; ++n)
+  {
+    // Wait for the scheduled time, only sleeping while it is far off since
+    // oversleeping would be charged to the graph.  If we are late (the graph
+    // pushed back), send immediately: the delay is charged to the tuple
+    // because its latency is measured from m_intended[n].
+    for (boost::int64_t wait = m_intended[n] - since(start); wait > 0;
+         wait = m_intended[n] - since(start))
+    {
+      if (wait > 2000000)
+        boost::this_thread::sleep_for(
+          boost::chrono::nanoseconds(wait - 1000000));
+      else
+        boost::this_thread::yield();
+    }
+
+    inject(firstId + n);
+  }
+
+  boost::mutex::scoped_lock l(m_mutex);
+  m_result.sent = m_count;
+  while (m_result.completed < m_count)
+  {
+    if (m_done.wait_for(l, boost::chrono::milliseconds(drainTimeoutMillis)) ==
+        boost::cv_status::timeout)
+      break;
+  }
+
+  // Stragglers from this run are ignored from now on.
+  m_running = false;
+  m_firstId += m_count;
+
+  if (m_last > 0)
+    m_result.achievedRate = m_result.completed * 1e9 / double(m_last);
+  return m_result;
+}
+
+//------------------------------------------------------------------------------
+inline void open_loop_harness::complete(size_t id)
+{
+  clock_t::time_point const now = clock_t::now();
+
+  boost::mutex::scoped_lock l(m_mutex);
+  if (! m_running)
+    return;
+  if ((id < m_firstId) || (id - m_firstId >= m_count))
+  {
+    ++m_result.stale;
+    return;
+  }
+
+  size_t const n = id - m_firstId;
+  if (m_completed[n])
+  {
+    ++m_result.duplicates;
+    return;
+  }
+  m_completed[n] = true;
+
+  boost::int64_t const elapsed =
+    boost::chrono::duration_cast<boost::chrono::nanoseconds>(
+      now - m_start).count();
+  m_result.latency.record(latency_histogram::value_t(
+    std::max<boost::int64_t>(elapsed - m_intended[n], 0)));
+  m_last = std::max(m_last, elapsed);
+  if (++m_result.completed == m_count)
+    m_done.notify_all();
+}
+
+#endif
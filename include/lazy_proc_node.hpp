@@ -0,0 +1,271 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(LAZY_PROC_NODE_HPP)
+#define LAZY_PROC_NODE_HPP
+
+#include <boost/array.hpp>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/mpl.hpp>
+#include <boost/fusion/include/value_at.hpp>
+#include <boost/fusion/include/value_of.hpp>
+#include <boost/mpl/assert.hpp>
+#include <boost/type_traits/is_same.hpp>
+
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+/** This object provides a demand-driven (pull) counterpart to proc_node.
+ * Rather than queueing every input set and computing on every visit, a lazy
+ * node only keeps the latest value of each input component and the last
+ * computed output.  Updates merely mark the node, and everything downstream
+ * of it, dirty; visit_impl() is only dispatched when an output is read and
+ * the node is dirty.  Reading an output recursively pulls from dirty
+ * upstream nodes, so only the stale part of the graph is recomputed.
+ *
+ * Each input port is either pushed to explicitly (enqueue<N>()) or bound to
+ * an output component of an upstream lazy node (source<N, M>()).
+ *
+ * As with proc_node, we use CRTP.  Derived classes implement:
+ *   Output_T visit_impl();
+ * and read the current input set via input().
+ * NOTE: No synchronization is provided.
+ */
+template<typename Derived_T, typename Input_T, typename Output_T>
+class lazy_proc_node
+{
+public:
+  lazy_proc_node();
+
+  /** Unregister from every upstream node. */
+  ~lazy_proc_node();
+
+  /** Set the N-th input component, and mark this node and its dependents
+   * dirty.  Any upstream source bound to the component is unbound.
+   * @param[in] component The new value of the input component.
+   */
+  template<size_t N, typename InputComponent_T>
+  void enqueue(const InputComponent_T & component)
+  {
+    typedef typename boost::fusion::result_of::value_at_c<Input_T, N>::type
+      InputComponent_t;
+    BOOST_MPL_ASSERT(( boost::is_same<InputComponent_t, InputComponent_T> ));
+
+    this->detach(N);
+    boost::fusion::at_c<N>(m_input) = component;
+    m_bound[N] = true;
+    this->invalidate();
+  }
+
+  /** Bind the N-th input component to the M-th output component of an
+   * upstream lazy node, replacing any earlier binding of the component.  The
+   * upstream node will invalidate this node when it becomes dirty, and will
+   * be pulled when this node is read.  This node unregisters itself from
+   * upstream when it is destroyed.
+   * TRICKY: upstream must outlive this node.
+   */
+  template<size_t N, size_t M, typename Upstream_T>
+  void source(Upstream_T & upstream)
+  {
+    typedef typename boost::fusion::result_of::value_at_c<Input_T, N>::type
+      InputComponent_t;
+    typedef typename Upstream_T::template output_component<M>::type
+      OutputComponent_t;
+    BOOST_MPL_ASSERT(( boost::is_same<InputComponent_t, OutputComponent_t> ));
+
+    this->detach(N);
+    m_sources[N] = boost::bind(& lazy_proc_node::pull<N, M, Upstream_T>,
+                               & upstream, _1);
+    m_detach[N] = boost::bind(& Upstream_T::remove_dependent, & upstream,
+                              static_cast<const void *>(this));
+    m_bound[N] = true;
+    upstream.add_dependent(this,
+                           boost::bind(& lazy_proc_node::invalidate, this));
+    this->invalidate();
+  }
+
+  /** Register a callback to be invoked when this node becomes dirty.
+   * @param[in] dependent Identifies the registration for remove_dependent().
+   * @param[in] invalidate The callback.
+   */
+  void add_dependent(const void * dependent,
+                     const boost::function<void ()> & invalidate)
+  { m_dependents.push_back(std::make_pair(dependent, invalidate)); }
+
+  /** Remove one registration made by add_dependent() for dependent. */
+  void remove_dependent(const void * dependent);
+
+  /** Mark this node dirty and propagate to all dependents.  Propagation
+   * stops at nodes that are already dirty. */
+  void invalidate();
+
+  /** @return true if every input component has a value or a source. */
+  bool is_ready() const;
+
+  /** @return true if the output is stale and will be recomputed on the next
+   *   read. */
+  bool is_dirty() const { return m_dirty; }
+
+  /** @return The current output, recomputing it (and any stale upstream
+   *   nodes) if necessary. */
+  const Output_T & value();
+
+  /** The type of the M-th output component. */
+  template<size_t M>
+  struct output_component
+  {
+    typedef typename boost::fusion::result_of::value_at_c<Output_T, M>::type
+      type;
+  };
+
+  /** @return The M-th component of value(). */
+  template<size_t M>
+  typename output_component<M>::type output()
+  { return boost::fusion::at_c<M>(this->value()); }
+
+  /** @return the processed output value(s). */
+  Output_T visit() { return this->value(); }
+
+protected:
+  /** @return The latest input set. */
+  const Input_T & input() const { return m_input; }
+
+private:
+  /** Copy the M-th output component of upstream into input component N. */
+  template<size_t N, size_t M, typename Upstream_T>
+  static void pull(Upstream_T * upstream, Input_T & input)
+  { boost::fusion::at_c<N>(input) = upstream->template output<M>(); }
+
+  /** Unbind the n-th input component from its upstream node, if any. */
+  void detach(size_t n);
+
+  /** The cardinality of the input tuple. */
+  static size_t const CARDINALITY =
+    boost::fusion::result_of::size<Input_T>::type::value;
+
+  /** The latest input set. */
+  Input_T m_input;
+  /** The last computed output. */
+  Output_T m_output;
+  /** true indicates m_output is stale. */
+  bool m_dirty;
+  /** true indicates the input component has a value or a source. */
+  boost::array<bool, CARDINALITY> m_bound;
+  /** Upstream pull functions; empty for pushed components. */
+  boost::array<boost::function<void (Input_T &)>, CARDINALITY> m_sources;
+  /** Unregister functions for m_sources; empty for pushed components. */
+  boost::array<boost::function<void ()>, CARDINALITY> m_detach;
+  /** Invalidation callbacks of downstream nodes, with their registration
+   * keys. */
+  std::vector<std::pair<const void *, boost::function<void ()> > >
+    m_dependents;
+};
+
+
+//==============================================================================
+template<typename Derived_T, typename Input_T, typename Output_T>
+lazy_proc_node<Derived_T, Input_T, Output_T>::lazy_proc_node()
+:
+  m_input(),
+  m_output(),
+  m_dirty(true),
+  m_bound(),
+  m_sources(),
+  m_detach(),
+  m_dependents()
+{
+  m_bound.assign(false);
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+lazy_proc_node<Derived_T, Input_T, Output_T>::~lazy_proc_node()
+{
+  for (size_t n = 0; n < CARDINALITY; ++n)
+    this->detach(n);
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+void lazy_proc_node<Derived_T, Input_T, Output_T>::
+remove_dependent(const void * dependent)
+{
+  for (size_t n = 0; n < m_dependents.size(); ++n)
+  {
+    if (m_dependents[n].first == dependent)
+    {
+      m_dependents.erase(m_dependents.begin() + n);
+      return;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+void lazy_proc_node<Derived_T, Input_T, Output_T>::detach(size_t n)
+{
+  if (! m_detach[n])
+    return;
+
+  m_detach[n]();
+  m_detach[n].clear();
+  m_sources[n].clear();
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+void lazy_proc_node<Derived_T, Input_T, Output_T>::invalidate()
+{
+  // TRICKY: A clean node implies that everything upstream of it is clean, so
+  // a dirty node's dependents have already been invalidated.
+  if (m_dirty)
+    return;
+
+  m_dirty = true;
+  for (size_t n = 0; n < m_dependents.size(); ++n)
+    m_dependents[n].second();
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+bool lazy_proc_node<Derived_T, Input_T, Output_T>::is_ready() const
+{
+  for (size_t n = 0; n < CARDINALITY; ++n)
+  {
+    if (! m_bound[n])
+      return false;
+  }
+
+  return true;
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+const Output_T & lazy_proc_node<Derived_T, Input_T, Output_T>::value()
+{
+  if (! m_dirty)
+    return m_output;
+
+  if (! this->is_ready())
+    throw std::runtime_error("lazy_proc_node not ready");
+
+  // Pull the current upstream values; clean upstream nodes return their
+  // cached outputs.
+  for (size_t n = 0; n < CARDINALITY; ++n)
+  {
+    if (m_sources[n])
+      m_sources[n](m_input);
+  }
+
+  m_output = static_cast<Derived_T *>(this)->visit_impl();
+  m_dirty = false;
+  return m_output;
+}
+
+#endif
@@ -0,0 +1,308 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(MEMO_CACHE_HPP)
+#define MEMO_CACHE_HPP
+
+#include <boost/fusion/include/fold.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <list>
+#include <vector>
+
+//==============================================================================
+/** Hashes a fusion sequence (e.g. an Input_T tuple) by folding boost::hash
+ * over each of its components.
+ */
+template<typename Sequence_T>
+struct fusion_hash
+{
+  typedef size_t result_type;
+
+  size_t operator()(const Sequence_T & seq) const
+  { return boost::fusion::fold(seq, size_t(0), combine()); }
+
+private:
+  struct combine
+  {
+    typedef size_t result_type;
+
+    template<typename Component_T>
+    size_t operator()(size_t seed, const Component_T & component) const
+    {
+      boost::hash_combine(seed, component);
+      return seed;
+    }
+  };
+};
+
+//==============================================================================
+/** Least-recently-used eviction.  Every hit moves the entry to the front of
+ * the recency list; the entry at the back is evicted when the cache is full.
+ * NOTE: Not synchronized; see memo_cache.
+ */
+template<typename Key_T, typename Value_T, typename Hash_T>
+class lru_eviction
+{
+public:
+  /** @param[in] capacity The maximum number of entries.  0 indicates
+   *    unbounded size.  */
+  explicit lru_eviction(size_t capacity)
+  : m_capacity(capacity), m_entries(), m_index()
+  {}
+
+  /** @param[in] key The key to look up.
+   * @param[out] value Set to the cached value on a hit.
+   * @return true if the key was found. */
+  bool find(const Key_T & key, Value_T & value)
+  {
+    typename Index_t::iterator i = m_index.find(key);
+    if (i == m_index.end())
+      return false;
+
+    // Move to the most-recently-used position.
+    m_entries.splice(m_entries.begin(), m_entries, i->second);
+    value = i->second->second;
+    return true;
+  }
+
+  /** Insert (or refresh) an entry, evicting the least recently used entry if
+   * the cache is full. */
+  void insert(const Key_T & key, const Value_T & value)
+  {
+    typename Index_t::iterator i = m_index.find(key);
+    if (i != m_index.end())
+    {
+      i->second->second = value;
+      m_entries.splice(m_entries.begin(), m_entries, i->second);
+      return;
+    }
+
+    if (m_capacity && (m_entries.size() >= m_capacity))
+    {
+      m_index.erase(m_entries.back().first);
+      m_entries.pop_back();
+    }
+
+    m_entries.push_front(Entry_t(key, value));
+    m_index[key] = m_entries.begin();
+  }
+
+  size_t size() const { return m_entries.size(); }
+  size_t capacity() const { return m_capacity; }
+
+  void clear()
+  {
+    m_index.clear();
+    m_entries.clear();
+  }
+
+private:
+  typedef std::pair<Key_T, Value_T> Entry_t;
+  typedef std::list<Entry_t> Entries_t;
+  typedef boost::unordered_map<Key_T, typename Entries_t::iterator, Hash_T>
+    Index_t;
+
+  /** The maximum number of entries. */
+  size_t m_capacity;
+  /** Entries in most-recently-used order. */
+  Entries_t m_entries;
+  /** Key to entry lookup. */
+  Index_t m_index;
+};
+
+//==============================================================================
+/** CLOCK (second chance) eviction.  A hit only sets a reference bit, which
+ * makes hits cheaper than LRU at the cost of a coarser approximation of
+ * recency.  The clock hand sweeps the slots, clearing reference bits, and
+ * evicts the first unreferenced entry.
+ * NOTE: Not synchronized; see memo_cache.
+ */
+template<typename Key_T, typename Value_T, typename Hash_T>
+class clock_eviction
+{
+public:
+  /** @param[in] capacity The maximum number of entries.  0 indicates
+   *    unbounded size.  */
+  explicit clock_eviction(size_t capacity)
+  : m_capacity(capacity), m_slots(), m_index(), m_hand(0)
+  {}
+
+  /** @param[in] key The key to look up.
+   * @param[out] value Set to the cached value on a hit.
+   * @return true if the key was found. */
+  bool find(const Key_T & key, Value_T & value)
+  {
+    typename Index_t::iterator i = m_index.find(key);
+    if (i == m_index.end())
+      return false;
+
+    Slot & slot = m_slots[i->second];
+    slot.referenced = true;
+    value = slot.value;
+    return true;
+  }
+
+  /** Insert (or refresh) an entry, evicting an unreferenced entry if the
+   * cache is full. */
+  void insert(const Key_T & key, const Value_T & value)
+  {
+    typename Index_t::iterator i = m_index.find(key);
+    if (i != m_index.end())
+    {
+      Slot & slot = m_slots[i->second];
+      slot.value = value;
+      slot.referenced = true;
+      return;
+    }
+
+    if (! m_capacity || (m_slots.size() < m_capacity))
+    {
+      m_index[key] = m_slots.size();
+      m_slots.push_back(Slot(key, value));
+      return;
+    }
+
+    // Advance the hand until we find a slot without a second chance.
+    while (m_slots[m_hand].referenced)
+    {
+      m_slots[m_hand].referenced = false;
+      m_hand = (m_hand + 1) % m_slots.size();
+    }
+
+    Slot & victim = m_slots[m_hand];
+    m_index.erase(victim.key);
+    victim = Slot(key, value);
+    m_index[key] = m_hand;
+    m_hand = (m_hand + 1) % m_slots.size();
+  }
+
+  size_t size() const { return m_slots.size(); }
+  size_t capacity() const { return m_capacity; }
+
+  void clear()
+  {
+    m_index.clear();
+    m_slots.clear();
+    m_hand = 0;
+  }
+
+private:
+  struct Slot
+  {
+    Slot(const Key_T & k, const Value_T & v)
+    : key(k), value(v), referenced(false)
+    {}
+
+    Key_T key;
+    Value_T value;
+    bool referenced;
+  };
+
+  typedef boost::unordered_map<Key_T, size_t, Hash_T> Index_t;
+
+  /** The maximum number of entries. */
+  size_t m_capacity;
+  /** The clock's ring of entries. */
+  std::vector<Slot> m_slots;
+  /** Key to slot lookup. */
+  Index_t m_index;
+  /** The current position of the clock hand. */
+  size_t m_hand;
+};
+
+//==============================================================================
+/** A bounded, synchronized key/value cache with pluggable eviction
+ * (lru_eviction or clock_eviction) and hit/miss counters.
+ * All access is serialized by a single mutex, so one cache may be shared by
+ * several nodes running on different threads.
+ */
+template<typename Key_T, typename Value_T,
+         template<typename, typename, typename> class Eviction_T = lru_eviction,
+         typename Hash_T = boost::hash<Key_T> >
+class memo_cache
+{
+public:
+  /** @param[in] capacity The maximum number of cached entries.  0 indicates
+   *    unbounded size.  */
+  explicit memo_cache(size_t capacity)
+  : m_mutex(), m_entries(capacity), m_hits(0), m_misses(0)
+  {}
+
+  /** Look up a key and update the hit/miss counters.
+   * @param[in] key The key to look up.
+   * @param[out] value Set to the cached value on a hit.
+   * @return true if the key was found. */
+  bool find(const Key_T & key, Value_T & value)
+  {
+    mutex_t::scoped_lock l(m_mutex);
+    if (m_entries.find(key, value))
+    {
+      ++m_hits;
+      return true;
+    }
+
+    ++m_misses;
+    return false;
+  }
+
+  /** Insert a value, evicting an entry if the cache is full. */
+  void insert(const Key_T & key, const Value_T & value)
+  {
+    mutex_t::scoped_lock l(m_mutex);
+    m_entries.insert(key, value);
+  }
+
+  /** @return The number of lookups that were satisfied from the cache. */
+  size_t hits() const
+  {
+    mutex_t::scoped_lock l(m_mutex);
+    return m_hits;
+  }
+
+  /** @return The number of lookups that were not found in the cache. */
+  size_t misses() const
+  {
+    mutex_t::scoped_lock l(m_mutex);
+    return m_misses;
+  }
+
+  /** @return The current number of cached entries. */
+  size_t size() const
+  {
+    mutex_t::scoped_lock l(m_mutex);
+    return m_entries.size();
+  }
+
+  /** @return The maximum number of cached entries. */
+  size_t capacity() const
+  {
+    mutex_t::scoped_lock l(m_mutex);
+    return m_entries.capacity();
+  }
+
+  /** Drop all cached entries and reset the counters. */
+  void clear()
+  {
+    mutex_t::scoped_lock l(m_mutex);
+    m_entries.clear();
+    m_hits = 0;
+    m_misses = 0;
+  }
+
+private:
+  typedef boost::mutex mutex_t;
+
+  /** Mutex for synchronizing access to the entries and counters. */
+  mutable mutex_t m_mutex;
+  /** The cached entries and eviction state. */
+  Eviction_T<Key_T, Value_T, Hash_T> m_entries;
+  size_t m_hits;
+  size_t m_misses;
+};
+
+#endif
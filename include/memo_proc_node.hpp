@@ -0,0 +1,96 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(MEMO_PROC_NODE_HPP)
+#define MEMO_PROC_NODE_HPP
+
+#include "memo_cache.hpp"
+#include "proc_node.hpp"
+
+#include <boost/fusion/include/comparison.hpp>
+
+//==============================================================================
+/** This object memoizes a pure processing node: the ready input tuple is
+ * hashed (component-wise, via fusion_hash) and looked up in a bounded
+ * memo_cache, and the derived class is only invoked on a miss.
+ *
+ * Node_T selects the node flavor to memoize (proc_node, shared_proc_node,
+ * or active_proc_node).  Eviction_T selects lru_eviction or clock_eviction.
+ *
+ * Derived classes implement the following interface instead of visit_impl():
+ *   Output_T memo_visit_impl(const Input_T & input);
+ * TRICKY: memo_visit_impl() must be a pure function of its input, since
+ * cached outputs are returned without calling it.  Input_T must be
+ * equality comparable and its components hashable with boost::hash.
+ */
+template<typename Derived_T, typename Input_T, typename Output_T,
+         template<typename, typename, typename> class Node_T = proc_node,
+         template<typename, typename, typename> class Eviction_T = lru_eviction>
+class memo_proc_node : public Node_T<Derived_T, Input_T, Output_T>
+{
+public:
+  typedef memo_cache<Input_T, Output_T, Eviction_T, fusion_hash<Input_T> >
+    Cache_t;
+
+  /** @param[in] cacheSize The maximum number of memoized results.  0
+   *    indicates unbounded size.
+   * @param[in] maxQueueSize The maximum size of the work queue.  0 indicates
+   *    unbounded size.  */
+  explicit memo_proc_node(size_t cacheSize, size_t maxQueueSize = 0);
+
+  ~memo_proc_node() {}
+
+  /** Dispatched to by visit(): return the memoized output for the input at
+   * the front of the queue, calling memo_visit_impl() only on a miss. */
+  Output_T visit_impl();
+
+  /** @return The number of visits satisfied from the cache. */
+  size_t cacheHits() const { return m_cache.hits(); }
+
+  /** @return The number of visits that called memo_visit_impl(). */
+  size_t cacheMisses() const { return m_cache.misses(); }
+
+  const Cache_t & cache() const { return m_cache; }
+  Cache_t & cache() { return m_cache; }
+
+private:
+  typedef Node_T<Derived_T, Input_T, Output_T> node_t;
+
+  /** Memoized outputs keyed by input tuple. */
+  Cache_t m_cache;
+};
+
+
+//==============================================================================
+template<typename Derived_T, typename Input_T, typename Output_T,
+         template<typename, typename, typename> class Node_T,
+         template<typename, typename, typename> class Eviction_T>
+memo_proc_node<Derived_T, Input_T, Output_T, Node_T, Eviction_T>::
+memo_proc_node(size_t cacheSize, size_t maxQueueSize)
+:
+  node_t(maxQueueSize),
+  m_cache(cacheSize)
+{
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T,
+         template<typename, typename, typename> class Node_T,
+         template<typename, typename, typename> class Eviction_T>
+Output_T memo_proc_node<Derived_T, Input_T, Output_T, Node_T, Eviction_T>::
+visit_impl()
+{
+  const Input_T & input = this->inputQueue().front();
+
+  Output_T output;
+  if (m_cache.find(input, output))
+    return output;
+
+  output = static_cast<Derived_T *>(this)->memo_visit_impl(input);
+  m_cache.insert(input, output);
+  return output;
+}
+
+#endif
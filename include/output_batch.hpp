@@ -0,0 +1,156 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(OUTPUT_BATCH_HPP)
+#define OUTPUT_BATCH_HPP
+
+#include <boost/atomic.hpp>
+#include <boost/chrono.hpp>
+
+#include <algorithm>
+#include <vector>
+
+//==============================================================================
+/** This object is a producer-side buffer on one edge into the N-th input of a
+ * shared_proc_node (or active_proc_node).  Components are collected locally
+ * and published with a single enqueue_range() call -- one lock and one
+ * notification -- when the buffer reaches batchSize, or when the oldest
+ * buffered component has waited timeoutMicros.  This bounds the extra
+ * latency a component can pick up to the timeout.
+ *
+ * NOTE: No synchronization is provided; each producer thread owns its own
+ * batched_edge.  The exceptions are batchSize(), published() and batches(),
+ * which any thread may call (see queue_tuner::add_edge()).  The timeout is checked on push() and poll(), so an idle
+ * producer must call poll() (or flush()) periodically, and flush() at end of
+ * stream.
+ * TRICKY: The destructor never blocks, so whatever the consumer cannot accept
+ * at that point is lost.  Call flush() before destroying the edge to publish
+ * everything.
+ */
+template<typename Node_T, int N, typename Component_T>
+class batched_edge
+{
+public:
+  typedef boost::chrono::steady_clock clock_t;
+
+  /** @param[in] consumer The node to publish to.
+   * @param[in] batchSize Publish once this many components are buffered.
+   * @param[in] timeoutMicros Publish once the oldest buffered component is
+   *   this old.  0 publishes on every push.
+   * @param[in] block Passed through to enqueue_range(). */
+  batched_edge(Node_T & consumer, size_t batchSize, unsigned timeoutMicros,
+               bool block = true)
+  :
+    m_consumer(consumer),
+    m_batchSize(std::max<size_t>(batchSize, 1)),
+    m_timeout(boost::chrono::microseconds(timeoutMicros)),
+    m_block(block),
+    m_buffer(),
+    m_oldest(),
+    m_published(0),
+    m_batches(0)
+  {
+    m_buffer.reserve(this->batchSize());
+  }
+
+  /** Publish what the consumer can accept without blocking.  Blocking here
+   * could wait forever, or throw boost::thread_interrupted out of a
+   * destructor when the producer's thread is being shut down. */
+  ~batched_edge()
+  {
+    try
+    {
+      this->publish(false);
+    }
+    catch (...)
+    {
+      // Don't propagate from a destructor.
+    }
+  }
+
+  /** Buffer a component, publishing the batch if it is full or has timed
+   * out.
+   * @return The number of components published by this call. */
+  size_t push(const Component_T & component)
+  {
+    if (m_buffer.empty())
+      m_oldest = clock_t::now();
+    m_buffer.push_back(component);
+
+    if (m_buffer.size() >= m_batchSize.load(boost::memory_order_relaxed))
+      return this->flush();
+    return this->poll();
+  }
+
+  /** Publish the batch if the oldest buffered component has timed out.
+   * @return The number of components published by this call. */
+  size_t poll()
+  {
+    if (m_buffer.empty() || (clock_t::now() - m_oldest < m_timeout))
+      return 0;
+    return this->flush();
+  }
+
+  /** Publish everything buffered, e.g. at end of stream.
+   * @return The number of components the consumer accepted. */
+  size_t flush() { return this->publish(m_block); }
+
+  /** @return The number of buffered components. */
+  size_t size() const { return m_buffer.size(); }
+
+  /** @return The batch size that triggers publishing. */
+  size_t batchSize() const
+  { return m_batchSize.load(boost::memory_order_relaxed); }
+
+  /** @param[in] size The batch size that triggers publishing.  Takes effect
+   *   from the next push(). */
+  void batchSize(size_t size)
+  {
+    m_batchSize.store(std::max<size_t>(size, 1),
+                      boost::memory_order_relaxed);
+  }
+
+  /** @return The total number of components the consumer accepted. */
+  size_t published() const
+  { return m_published.load(boost::memory_order_relaxed); }
+
+  /** @return The number of batches published. */
+  size_t batches() const
+  { return m_batches.load(boost::memory_order_relaxed); }
+
+private:
+  /** Publish everything buffered.
+   * @param[in] block Passed through to enqueue_range().
+   * @return The number of components the consumer accepted. */
+  size_t publish(bool block)
+  {
+    if (m_buffer.empty())
+      return 0;
+
+    size_t const published = m_consumer.template enqueue_range<N>(
+      m_buffer.begin(), m_buffer.end(), block);
+    m_buffer.clear();
+
+    // TRICKY: Only the producer writes the counters, so a read-modify-write
+    //   is not needed to keep them exact.
+    m_published.store(this->published() + published,
+                      boost::memory_order_relaxed);
+    m_batches.store(this->batches() + 1, boost::memory_order_relaxed);
+    return published;
+  }
+
+  Node_T & m_consumer;
+  boost::atomic<size_t> m_batchSize;
+  clock_t::duration m_timeout;
+  bool m_block;
+  /** Buffered components, oldest first. */
+  std::vector<Component_T> m_buffer;
+  /** When the oldest buffered component was pushed. */
+  clock_t::time_point m_oldest;
+  boost::atomic<size_t> m_published;
+  boost::atomic<size_t> m_batches;
+};
+
+#endif
@@ -10,7 +10,10 @@
 #include <boost/fusion/include/at_c.hpp>
 #include <boost/fusion/include/mpl.hpp>
 #include <boost/fusion/include/value_of.hpp>
+#include <boost/mpl/for_each.hpp>
+#include <boost/mpl/range_c.hpp>
 
+#include <algorithm>
 #include <deque>
 
 //==============================================================================
@@ -54,7 +57,7 @@ public:
   bool enqueue(const InputComponent_T & component)
   {
     // Return false if the queue is full.
-    if (m_maxQueueSize && (m_inputs.size() >= m_maxQueueSize))
+    if (this->full(N))
       return false;
 
     typedef typename boost::fusion::result_of::begin<Input_T>::type first;
@@ -86,19 +89,67 @@ public:
   /** @return The current number of inputs in the queue. */
   size_t queueSize() const { return m_inputs.size(); }
 
+  /** @return true if the n-th input component would start a new input set,
+   *   but the queue is already at its maximum size. */
+  bool full(size_t n) const
+  {
+    return m_maxQueueSize && (m_numInputs[n] == m_inputs.size()) &&
+      (m_inputs.size() >= m_maxQueueSize);
+  }
+
   /** @return true if a complete set of input values is ready for processing. */
   bool is_ready() const;
 
   /** @return the processed output value(s). */
   Output_T visit();
 
+  /** Move every queued input component of other to the front of this node's
+   * queue, component by component, so that partially filled sets left in
+   * other are completed by components later enqueued to this node.  The
+   * queue may exceed maxQueueSize() until it drains.
+   * @param[in,out] other The node whose queue is emptied.
+   */
+  void take_inputs(proc_node & other);
+
 protected:
   /** Work queue type requires copy construction. */
   typedef std::deque<Input_T> InputQueue_t;
   const InputQueue_t & inputQueue() const { return m_inputs; }
   InputQueue_t & inputQueue() { return m_inputs; }
 
+  /** @return The number of complete input sets at the front of the queue. */
+  size_t readyCount() const;
+
+  /** Remove the input set at index (complete or not), keeping the
+   * per-component counts in step with the queue. */
+  void erase(size_t index);
+
 private:
+  /** Fills the N-th component of a merged queue with the N-th components
+   * queued in front, then those queued in back. */
+  struct merge_inputs
+  {
+    template<typename N_>
+    void operator()(N_) const
+    {
+      size_t const first = front->m_numInputs[N_::value];
+      for (size_t i = 0; i < first; ++i)
+      {
+        boost::fusion::at_c<N_::value>((*merged)[i]) =
+          boost::fusion::at_c<N_::value>(front->m_inputs[i]);
+      }
+      for (size_t i = 0; i < back->m_numInputs[N_::value]; ++i)
+      {
+        boost::fusion::at_c<N_::value>((*merged)[first + i]) =
+          boost::fusion::at_c<N_::value>(back->m_inputs[i]);
+      }
+    }
+
+    const proc_node * front;
+    const proc_node * back;
+    InputQueue_t * merged;
+  };
+
   /** The maximum allowed queue size. */
   size_t m_maxQueueSize;
   /** Work queue. */
@@ -148,6 +199,52 @@ bool proc_node<Derived_T, Input_T, Output_T>::is_ready() const
   return true;
 }
 
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+size_t proc_node<Derived_T, Input_T, Output_T>::readyCount() const
+{
+  return *std::min_element(m_numInputs.begin(), m_numInputs.end());
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+void proc_node<Derived_T, Input_T, Output_T>::erase(size_t index)
+{
+  m_inputs.erase(m_inputs.begin() + index);
+
+  // Component n of the set at index was present iff index < m_numInputs[n].
+  for (size_t n = 0; n < CARDINALITY; ++n)
+  {
+    if (index < m_numInputs[n])
+      --m_numInputs[n];
+  }
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+void proc_node<Derived_T, Input_T, Output_T>::take_inputs(proc_node & other)
+{
+  if (& other == this)
+    return;
+
+  boost::array<size_t, CARDINALITY> counts;
+  size_t size = 0;
+  for (size_t n = 0; n < CARDINALITY; ++n)
+  {
+    counts[n] = other.m_numInputs[n] + m_numInputs[n];
+    size = std::max(size, counts[n]);
+  }
+
+  InputQueue_t merged(size);
+  merge_inputs const merge = { & other, this, & merged };
+  boost::mpl::for_each<boost::mpl::range_c<size_t, 0, CARDINALITY> >(merge);
+
+  m_inputs.swap(merged);
+  m_numInputs = counts;
+  other.m_inputs.clear();
+  other.m_numInputs.assign(0);
+}
+
 //------------------------------------------------------------------------------
 template<typename Derived_T, typename Input_T, typename Output_T>
 Output_T proc_node<Derived_T, Input_T, Output_T>::visit()
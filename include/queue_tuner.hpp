@@ -0,0 +1,432 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(QUEUE_TUNER_HPP)
+#define QUEUE_TUNER_HPP
+
+#include "shared_proc_node.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//==============================================================================
+/** A record of one change made by queue_tuner. */
+struct tuning_decision
+{
+  enum setting_t
+  {
+    /** A node's maxQueueSize. */
+    max_queue_size,
+    /** A batched_edge's batchSize. */
+    batch_size
+  };
+
+  tuning_decision()
+  : node(), setting(max_queue_size), oldValue(0), newValue(0), queueSize(0),
+    visitMicros(0.0), blockedFraction(0.0), publishRate(0.0),
+    averageBatch(0.0), reason("")
+  {}
+
+  /** The name the node or edge was registered with. */
+  std::string node;
+  /** What was changed, and its value before and after the change. */
+  setting_t setting;
+  size_t oldValue;
+  size_t newValue;
+
+  /** max_queue_size only: The queue depth when the decision was made. */
+  size_t queueSize;
+  /** max_queue_size only: Average visit latency over the sample interval. */
+  double visitMicros;
+  /** max_queue_size only: Producer time spent blocked, as a fraction of the
+   * sample interval. */
+  double blockedFraction;
+
+  /** batch_size only: Components published per second over the sample
+   * interval. */
+  double publishRate;
+  /** batch_size only: Average components per published batch. */
+  double averageBatch;
+
+  /** Why the change was made. */
+  const char * reason;
+};
+
+/** Write a tuning_decision to std::clog. */
+inline void log_tuning_decision(const tuning_decision & d)
+{
+  std::clog << "queue_tuner: " << d.node << ": ";
+  if (d.setting == tuning_decision::batch_size)
+  {
+    std::clog << "batchSize " << d.oldValue << " -> " << d.newValue
+              << " (" << d.reason << "; rate " << d.publishRate
+              << "/s, average batch " << d.averageBatch << ")" << std::endl;
+  }
+  else
+  {
+    std::clog << "maxQueueSize " << d.oldValue << " -> " << d.newValue
+              << " (" << d.reason << "; depth " << d.queueSize
+              << ", visit " << d.visitMicros << "us, blocked "
+              << d.blockedFraction * 100.0 << "%)" << std::endl;
+  }
+}
+
+//==============================================================================
+/** This object periodically samples the load counters and queue depth of a
+ * set of shared_proc_nodes (or active_proc_nodes) and adjusts their
+ * maxQueueSize at runtime:
+ *  - If the queued inputs would take longer than the target latency to drain
+ *    at the observed visit latency, the capacity is cut to fit the target
+ *    (target_latency goal only).  A queue holding less than that is left
+ *    alone, so that its spare capacity still absorbs bursts.
+ *  - If producers spent more than the blocked threshold of the interval
+ *    waiting for room, the capacity is doubled (bounded by the maximum, and
+ *    by the latency target when there is one).
+ * Nodes with unbounded queues (maxQueueSize of 0) are left alone.
+ *
+ * The batchSize of registered batched_edges is tuned the same way, within
+ * the same minimum and maximum:
+ *  - If filling a batch at the observed publish rate would take longer than
+ *    the target latency, the batch size is cut to fit the target
+ *    (target_latency goal only).
+ *  - If the published batches were full on average, so that the timeout
+ *    never had to publish a partial batch, the batch size is doubled.
+ *
+ * tune() runs one control step; startup() runs it periodically on a
+ * background thread.
+ */
+class queue_tuner
+{
+public:
+  enum goal_t
+  {
+    /** Keep the time to drain a full queue under the target latency. */
+    target_latency,
+    /** Grow queues whenever producers are throttled. */
+    max_throughput
+  };
+
+  /** @param[in] goal The tuning goal.
+   * @param[in] targetLatencyMicros The target queueing latency per node
+   *   (ignored for max_throughput).
+   * @param[in] minQueueSize The smallest capacity the tuner will set.
+   * @param[in] maxQueueSize The largest capacity the tuner will set.
+   */
+  explicit queue_tuner(goal_t goal, unsigned targetLatencyMicros = 0,
+                       size_t minQueueSize = 1, size_t maxQueueSize = 65536)
+  :
+    m_goal(goal),
+    m_targetLatencyMicros(targetLatencyMicros),
+    m_minQueueSize(std::max<size_t>(minQueueSize, 1)),
+    m_maxQueueSize(std::max(maxQueueSize, m_minQueueSize)),
+    m_blockedThreshold(0.01),
+    m_log(& log_tuning_decision),
+    m_mutex(),
+    m_nodes(),
+    m_edges(),
+    m_thread()
+  {}
+
+  ~queue_tuner() { this->shutdown(); }
+
+  /** Register a node to be tuned, and turn on its visit timing.
+   * TRICKY: node must outlive this object (or its background thread).
+   */
+  template<typename Node_T>
+  void add(Node_T & node, const std::string & name)
+  {
+    node.timeVisits(true);
+
+    entry e;
+    e.name = name;
+    e.stats = boost::bind(& queue_tuner::stats_of<Node_T>, & node);
+    e.queueSize = boost::bind(& queue_tuner::queue_size_of<Node_T>, & node);
+    e.getMax = boost::bind(& queue_tuner::max_of<Node_T>, & node);
+    e.setMax = boost::bind(& queue_tuner::set_max_of<Node_T>, & node, _1);
+    e.lastSample = now();
+
+    // Discard whatever accumulated before the node was registered.
+    e.stats();
+
+    boost::mutex::scoped_lock l(m_mutex);
+    m_nodes.push_back(e);
+  }
+
+  /** Register a batched_edge to be tuned.
+   * TRICKY: edge must outlive this object (or its background thread).
+   */
+  template<typename Edge_T>
+  void add_edge(Edge_T & edge, const std::string & name)
+  {
+    edge_entry e;
+    e.name = name;
+    e.published = boost::bind(& queue_tuner::published_of<Edge_T>, & edge);
+    e.batches = boost::bind(& queue_tuner::batches_of<Edge_T>, & edge);
+    e.getBatch = boost::bind(& queue_tuner::batch_of<Edge_T>, & edge);
+    e.setBatch = boost::bind(& queue_tuner::set_batch_of<Edge_T>, & edge, _1);
+    e.lastSample = now();
+    e.lastPublished = e.published();
+    e.lastBatches = e.batches();
+
+    boost::mutex::scoped_lock l(m_mutex);
+    m_edges.push_back(e);
+  }
+
+  /** @param[in] log Called for every change. */
+  void logger(const boost::function<void (const tuning_decision &)> & log)
+  {
+    boost::mutex::scoped_lock l(m_mutex);
+    m_log = log;
+  }
+
+  /** @param[in] fraction The fraction of a sample interval producers may
+   *   spend blocked before a queue is grown. */
+  void blockedThreshold(double fraction)
+  {
+    boost::mutex::scoped_lock l(m_mutex);
+    m_blockedThreshold = fraction;
+  }
+
+  /** Sample every registered node and edge and adjust its capacity or batch
+   * size. */
+  void tune();
+
+  /** Start calling tune() every period milliseconds on a background thread.
+   * @return true if a new thread was started. */
+  bool startup(unsigned periodMillis);
+
+  /** Stop and join the background thread, if any. */
+  void shutdown()
+  {
+    m_thread.interrupt();
+    m_thread.join();
+  }
+
+private:
+  struct entry
+  {
+    std::string name;
+    boost::function<queue_stats ()> stats;
+    boost::function<size_t ()> queueSize;
+    boost::function<size_t ()> getMax;
+    boost::function<void (size_t)> setMax;
+    boost::posix_time::ptime lastSample;
+  };
+
+  struct edge_entry
+  {
+    std::string name;
+    boost::function<size_t ()> published;
+    boost::function<size_t ()> batches;
+    boost::function<size_t ()> getBatch;
+    boost::function<void (size_t)> setBatch;
+    boost::posix_time::ptime lastSample;
+    size_t lastPublished;
+    size_t lastBatches;
+  };
+
+  template<typename Node_T>
+  static queue_stats stats_of(Node_T * node) { return node->stats(true); }
+
+  template<typename Node_T>
+  static size_t queue_size_of(Node_T * node) { return node->queueSize(); }
+
+  template<typename Node_T>
+  static size_t max_of(Node_T * node) { return node->maxQueueSize(); }
+
+  template<typename Node_T>
+  static void set_max_of(Node_T * node, size_t size)
+  { node->maxQueueSize(size); }
+
+  template<typename Edge_T>
+  static size_t published_of(Edge_T * edge) { return edge->published(); }
+
+  template<typename Edge_T>
+  static size_t batches_of(Edge_T * edge) { return edge->batches(); }
+
+  template<typename Edge_T>
+  static size_t batch_of(Edge_T * edge) { return edge->batchSize(); }
+
+  template<typename Edge_T>
+  static void set_batch_of(Edge_T * edge, size_t size)
+  { edge->batchSize(size); }
+
+  static boost::posix_time::ptime now()
+  { return boost::posix_time::microsec_clock::universal_time(); }
+
+  /** Sample one edge and adjust its batch size; see tune(). */
+  void tune_edge(edge_entry & e);
+
+  /** Background thread worker function. */
+  void run(unsigned periodMillis);
+
+  goal_t m_goal;
+  unsigned m_targetLatencyMicros;
+  size_t m_minQueueSize;
+  size_t m_maxQueueSize;
+  double m_blockedThreshold;
+  boost::function<void (const tuning_decision &)> m_log;
+
+  /** Mutex for synchronizing access to the settings and node list. */
+  boost::mutex m_mutex;
+  std::vector<entry> m_nodes;
+  std::vector<edge_entry> m_edges;
+  /** Background tuning thread. */
+  boost::thread m_thread;
+};
+
+
+//==============================================================================
+inline void queue_tuner::tune()
+{
+  boost::mutex::scoped_lock l(m_mutex);
+
+  for (size_t n = 0; n < m_nodes.size(); ++n)
+  {
+    entry & e = m_nodes[n];
+
+    boost::posix_time::ptime const sampled = now();
+    queue_stats const stats = e.stats();
+    double const elapsed = std::max<double>(
+      (sampled - e.lastSample).total_microseconds(), 1.0);
+    e.lastSample = sampled;
+
+    size_t const current = e.getMax();
+    if (! current)
+      continue;
+
+    tuning_decision d;
+    d.node = e.name;
+    d.setting = tuning_decision::max_queue_size;
+    d.oldValue = current;
+    d.newValue = current;
+    d.queueSize = e.queueSize();
+    d.visitMicros = stats.visits ?
+      double(stats.visitMicros) / stats.visits : 0.0;
+    d.blockedFraction = stats.blockedMicros / elapsed;
+
+    // The largest capacity that a full queue can drain within the target.
+    size_t ceiling = m_maxQueueSize;
+    if ((m_goal == target_latency) && (d.visitMicros > 0.0))
+    {
+      ceiling = std::min(ceiling, std::max(m_minQueueSize,
+        size_t(m_targetLatencyMicros / d.visitMicros)));
+    }
+
+    if (current > m_maxQueueSize)
+    {
+      d.newValue = m_maxQueueSize;
+      d.reason = "above tuner maximum";
+    }
+    else if ((current > ceiling) && (d.queueSize > ceiling))
+    {
+      d.newValue = ceiling;
+      d.reason = "queueing latency above target";
+    }
+    else if ((d.blockedFraction > m_blockedThreshold) && (current < ceiling))
+    {
+      d.newValue = std::min(ceiling, current * 2);
+      d.reason = "producers blocked";
+    }
+
+    if (d.newValue != current)
+    {
+      e.setMax(d.newValue);
+      if (m_log)
+        m_log(d);
+    }
+  }
+
+  for (size_t n = 0; n < m_edges.size(); ++n)
+    this->tune_edge(m_edges[n]);
+}
+
+//------------------------------------------------------------------------------
+inline void queue_tuner::tune_edge(edge_entry & e)
+{
+  // TRICKY: Called from tune() with the lock held.
+  boost::posix_time::ptime const sampled = now();
+  size_t const published = e.published();
+  size_t const batches = e.batches();
+  double const elapsed = std::max<double>(
+    (sampled - e.lastSample).total_microseconds(), 1.0);
+  double const perMicro = (published - e.lastPublished) / elapsed;
+
+  tuning_decision d;
+  d.node = e.name;
+  d.setting = tuning_decision::batch_size;
+  d.oldValue = e.getBatch();
+  d.newValue = d.oldValue;
+  d.publishRate = perMicro * 1e6;
+  d.averageBatch = (batches != e.lastBatches) ?
+    double(published - e.lastPublished) / (batches - e.lastBatches) : 0.0;
+
+  e.lastSample = sampled;
+  e.lastPublished = published;
+  e.lastBatches = batches;
+
+  // The largest batch that fills within the target at the observed rate.
+  size_t ceiling = m_maxQueueSize;
+  if ((m_goal == target_latency) && (perMicro > 0.0))
+  {
+    ceiling = std::min(ceiling, std::max(m_minQueueSize,
+      size_t(m_targetLatencyMicros * perMicro)));
+  }
+
+  if (d.oldValue > ceiling)
+  {
+    d.newValue = ceiling;
+    d.reason = (ceiling < m_maxQueueSize) ?
+      "batching delay above target" : "above tuner maximum";
+  }
+  else if ((d.averageBatch >= d.oldValue) && (d.oldValue < ceiling))
+  {
+    d.newValue = std::min(ceiling, d.oldValue * 2);
+    d.reason = "batches full";
+  }
+
+  if (d.newValue != d.oldValue)
+  {
+    e.setBatch(d.newValue);
+    if (m_log)
+      m_log(d);
+  }
+}
+
+//------------------------------------------------------------------------------
+inline bool queue_tuner::startup(unsigned periodMillis)
+{
+  if (m_thread.joinable())
+    return false;
+
+  m_thread = boost::thread(boost::bind(& queue_tuner::run, this,
+                                       periodMillis));
+  return true;
+}
+
+//------------------------------------------------------------------------------
+inline void queue_tuner::run(unsigned periodMillis)
+{
+  try
+  {
+    for (;;)
+    {
+      boost::this_thread::sleep(boost::posix_time::milliseconds(periodMillis));
+      this->tune();
+    }
+  }
+  catch (const boost::thread_interrupted &)
+  {
+    // shutdown() was called.
+  }
+}
+
+#endif
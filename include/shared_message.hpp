@@ -0,0 +1,160 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#if ! defined(SHARED_MESSAGE_HPP)
+#define SHARED_MESSAGE_HPP
+
+#include <boost/atomic.hpp>
+
+#include <algorithm>
+
+//==============================================================================
+/** Plain reference count for messages that never leave one thread, e.g.
+ * between proc_nodes driven by the same caller.
+ */
+class local_ref_count
+{
+public:
+  local_ref_count() : m_count(1) {}
+
+  void add_ref() { ++m_count; }
+
+  /** @return true if this released the last reference. */
+  bool release() { return --m_count == 0; }
+
+  size_t count() const { return m_count; }
+
+private:
+  size_t m_count;
+};
+
+//==============================================================================
+/** Atomic reference count for messages shared across threads, e.g. between
+ * shared_proc_nodes or active_proc_nodes.
+ */
+class atomic_ref_count
+{
+public:
+  atomic_ref_count() : m_count(1) {}
+
+  void add_ref() { m_count.fetch_add(1, boost::memory_order_relaxed); }
+
+  /** @return true if this released the last reference. */
+  bool release()
+  {
+    if (m_count.fetch_sub(1, boost::memory_order_release) != 1)
+      return false;
+
+    // Make the other owners' reads happen-before the delete.
+    boost::atomic_thread_fence(boost::memory_order_acquire);
+    return true;
+  }
+
+  size_t count() const { return m_count.load(boost::memory_order_relaxed); }
+
+private:
+  boost::atomic<size_t> m_count;
+};
+
+//==============================================================================
+/** This object is a handle to an immutable, reference counted message.  The
+ * payload and its reference count live in one allocation; copying the handle
+ * only bumps the count, so one payload can be enqueued to any number of
+ * consumers without copying it.  Use it as an Input_T/Output_T component in
+ * place of the payload type.
+ *
+ * RefCount_T selects the counting policy: local_ref_count when every holder
+ * is on the same thread, atomic_ref_count (the default) otherwise.
+ *
+ * A default constructed handle is empty (as required of tuple components by
+ * proc_node::enqueue).
+ */
+template<typename T, typename RefCount_T = atomic_ref_count>
+class shared_message
+{
+public:
+  /** Construct an empty handle. */
+  shared_message() : m_block(0) {}
+
+  /** Construct a message holding a copy of value. */
+  explicit shared_message(const T & value) : m_block(new block(value)) {}
+
+  shared_message(const shared_message & rhs) : m_block(rhs.m_block)
+  {
+    if (m_block)
+      m_block->refs.add_ref();
+  }
+
+  ~shared_message() { this->reset(); }
+
+  shared_message & operator=(const shared_message & rhs)
+  {
+    shared_message(rhs).swap(*this);
+    return *this;
+  }
+
+  /** Construct a message by swapping the contents of value into it, leaving
+   * value default constructed.  This avoids copying large payloads that
+   * support a cheap swap (e.g. std::vector).
+   */
+  static shared_message adopt(T & value)
+  {
+    shared_message message(new block());
+    using std::swap;
+    swap(message.m_block->value, value);
+    return message;
+  }
+
+  /** Release this handle's reference, leaving it empty. */
+  void reset()
+  {
+    if (m_block && m_block->refs.release())
+      delete m_block;
+    m_block = 0;
+  }
+
+  void swap(shared_message & rhs) { std::swap(m_block, rhs.m_block); }
+
+  /** @return true if this handle does not refer to a message. */
+  bool empty() const { return ! m_block; }
+
+  /** @return The number of handles referring to this message, or 0 if
+   *   empty. */
+  size_t use_count() const { return m_block ? m_block->refs.count() : 0; }
+
+  /** TRICKY: Undefined if empty(). */
+  const T & get() const { return m_block->value; }
+  const T & operator*() const { return m_block->value; }
+  const T * operator->() const { return & m_block->value; }
+
+  /** @return true if both handles refer to the same message. */
+  bool operator==(const shared_message & rhs) const
+  { return m_block == rhs.m_block; }
+  bool operator!=(const shared_message & rhs) const
+  { return m_block != rhs.m_block; }
+
+private:
+  /** The single allocation holding the count and the payload. */
+  struct block
+  {
+    block() : refs(), value() {}
+    explicit block(const T & v) : refs(), value(v) {}
+
+    RefCount_T refs;
+    T value;
+  };
+
+  explicit shared_message(block * b) : m_block(b) {}
+
+  block * m_block;
+};
+
+//------------------------------------------------------------------------------
+/** @return A new message holding a copy of value. */
+template<typename T>
+shared_message<T> make_message(const T & value)
+{ return shared_message<T>(value); }
+
+#endif
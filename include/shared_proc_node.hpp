@@ -8,9 +8,70 @@
 
 #include "proc_node.hpp"
 
+#include <boost/array.hpp>
+#include <boost/chrono.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/recursive_mutex.hpp>
 
+#include <algorithm>
+#include <set>
+
+//==============================================================================
+/** What a shared_proc_node does with an input component that arrives while
+ * its queue is full (see shared_proc_node::overloadPolicy()).
+ *
+ * Evicting policies only ever evict *complete* input sets, so that the
+ * components of partially filled sets stay aligned.  When no complete set is
+ * queued (or, for drop_lowest_priority, no priority function is set) the
+ * incoming component is dropped instead.  A dropped component always starts a
+ * new input set, so the whole set is dropped: the matching components on the
+ * other ports are discarded as they arrive, and later sets stay aligned.
+ */
+enum overload_policy
+{
+  /** Block the producer (or return false if not blocking).  The default. */
+  block_producer,
+  /** Drop the incoming component. */
+  drop_newest,
+  /** Evict the oldest complete input set. */
+  drop_oldest,
+  /** Drop one of the complete input sets or the incoming component, chosen
+   * uniformly at random (uniform random eviction).
+   * NOTE: This is not a uniform sample of all arrivals; survivors are skewed
+   * toward recent arrivals. */
+  drop_sampled,
+  /** Evict the complete input set with the lowest priority. */
+  drop_lowest_priority,
+
+  NUM_OVERLOAD_POLICIES
+};
+
+//==============================================================================
+/** Load counters accumulated by a shared_proc_node (see stats()). */
+struct queue_stats
+{
+  queue_stats()
+  : enqueues(0), blockedEnqueues(0), blockedMicros(0), visits(0),
+    visitMicros(0)
+  {}
+
+  /** Number of successfully enqueued input components. */
+  size_t enqueues;
+  /** Number of enqueue calls that had to wait for room in the queue. */
+  size_t blockedEnqueues;
+  /** Total time producers spent waiting for room in the queue. */
+  boost::uint64_t blockedMicros;
+  /** Number of completed visits. */
+  size_t visits;
+  /** Total time spent in visit_impl(), while visits are timed (see
+   * shared_proc_node::timeVisits()). */
+  boost::uint64_t visitMicros;
+};
+
 //==============================================================================
 /** This ... object provides a standard, generic interface for
  * passing jobs to a "processor" node.  All work is processed in FIFO order. 
@@ -39,7 +100,8 @@ public:
    * @param[in] component The input component to be processed.
    * @return true if the input component was successfully enqueued for
    *   processing, false otherwise.  false may indicate that the queue is
-   *   currently full.
+   *   currently full, or, with a shedding overloadPolicy(), that the
+   *   component was dropped along with the rest of its input set.
    */
   template<int N, typename InputComponent_T>
   bool enqueue(const InputComponent_T & component, bool block = true)
@@ -47,19 +109,41 @@ public:
     // TRICKY: The input queue is a shared resource, so synchronize access.
     mutex_t::scoped_lock l(m_mutex);
 
-    if (block)
+    bool const enqueued =
+      this->template enqueue_locked<N>(l, component, block);
+
+    // Notify any waiting threads that there is something on the queue.
+    if (enqueued)
+      m_notEmpty.notify_one();
+
+    return enqueued;
+  }
+
+  /** Enqueue a range of N-th input components under a single lock, with a
+   * single notification.  Each component is handled as by enqueue(): it may
+   * block, be shed, or (when not blocking) be refused if the queue is full.
+   * @param[in] first, last The input components to be processed.
+   * @return The number of components that were enqueued.
+   */
+  template<int N, typename Iterator_T>
+  size_t enqueue_range(Iterator_T first, Iterator_T last, bool block = true)
+  {
+    // TRICKY: The input queue is a shared resource, so synchronize access.
+    mutex_t::scoped_lock l(m_mutex);
+
+    size_t enqueued = 0;
+    for (; first != last; ++first)
     {
-      // Block if the queue is full.
-      while (this->maxQueueSize() && (this->queueSize() >=this->maxQueueSize()))
-        m_cond.wait(l);
-    }
+      // Let the consumer drain what we have added before we block.
+      if (enqueued && block && this->blocking(N))
+        m_notEmpty.notify_all();
 
-    // This will return false if the queue is full.
-    bool const enqueued = proc_node::enqueue<N>(component);
+      if (this->template enqueue_locked<N>(l, *first, block))
+        ++enqueued;
+    }
 
-    // Notify any waiting threads that there is something on the queue.
     if (enqueued)
-      m_cond.notify_one();
+      m_notEmpty.notify_all();
 
     return enqueued;
   }
@@ -77,18 +161,176 @@ public:
 
   Output_T visit();
 
+  /** @param[in] reset If true, zero the counters after sampling them.
+   * @return The load counters accumulated since the last reset. */
+  queue_stats stats(bool reset = false);
+
+  /** @return true if visit() measures visit latency for stats(). */
+  bool timeVisits() const;
+
+  /** @param[in] on true to measure visit latency for stats().  Off by
+   *   default, since it reads the clock twice per visit. */
+  void timeVisits(bool on);
+
+  /** @return The policy applied when enqueueing to a full queue. */
+  overload_policy overloadPolicy() const;
+
+  /** @param[in] policy The policy to apply when enqueueing to a full queue.
+   *   With any policy but block_producer, enqueue() never blocks. */
+  void overloadPolicy(overload_policy policy);
+
+  /** @param[in] priority Scores complete input sets for
+   *   drop_lowest_priority; the lowest scored set is evicted first. */
+  void priority(const boost::function<int (const Input_T &)> & priority);
+
+  /** @return The number of input sets dropped while policy was in effect.
+   *   A set dropped before all its components arrived counts once. */
+  size_t drops(overload_policy policy) const;
+
 protected:
   typedef boost::recursive_mutex mutex_t;
   mutex_t & mutex()       { return m_mutex; }
   mutex_t & mutex() const { return m_mutex; }
   typedef boost::condition_variable_any cond_t;
-  cond_t & cond() { return m_cond; }
+  /** @return The condition signalled when an input component arrives. */
+  cond_t & cond() { return m_notEmpty; }
 
 private:
+  /** Enqueue the N-th input component with the lock held (see enqueue()),
+   * without notifying waiters. */
+  template<int N, typename InputComponent_T>
+  bool enqueue_locked(mutex_t::scoped_lock & l,
+                      const InputComponent_T & component, bool block)
+  {
+    if (block && this->blocking(N))
+    {
+      // Block while the queue is full, and account for the time spent waiting.
+      wait_timer const timer(*this);
+      while (this->blocking(N))
+        m_notFull.wait(l);
+    }
+
+    // Discard the remaining components of an input set that was dropped.
+    boost::uint64_t const set = m_arrivals[N];
+    if (! m_droppedSets.empty() && m_droppedSets.count(set))
+    {
+      this->arrived(N);
+      return false;
+    }
+
+    // Shed load rather than pushing back on the producer.
+    if (this->full(N) && (m_overloadPolicy != block_producer) && ! this->shed())
+    {
+      // TRICKY: No other port has delivered its component of this set yet
+      // (full() means component N starts a new set), so dropping the set
+      // only requires discarding those components when they arrive.
+      m_droppedSets.insert(set);
+      this->arrived(N);
+      return false;
+    }
+
+    // This will return false if the queue is full.
+    bool const enqueued =
+      proc_node<Derived_T, Input_T, Output_T>::template enqueue<N>(component);
+    if (enqueued)
+    {
+      ++m_stats.enqueues;
+      this->arrived(N);
+    }
+
+    return enqueued;
+  }
+
+  /** Count an arrival on the n-th input, and forget dropped input sets
+   * that every input has now passed. */
+  void arrived(size_t n)
+  {
+    ++m_arrivals[n];
+    if (m_droppedSets.empty())
+      return;
+
+    boost::uint64_t const passed =
+      *std::min_element(m_arrivals.begin(), m_arrivals.end());
+    m_droppedSets.erase(m_droppedSets.begin(),
+                        m_droppedSets.lower_bound(passed));
+  }
+
+  /** @return true if the queue has no room for the n-th input component and
+   *   producers should wait. */
+  bool blocking(size_t n) const
+  { return this->full(n) && (m_overloadPolicy == block_producer); }
+
+  /** Make room for an incoming component according to the overload policy.
+   * @return true if a queued input set was evicted, false if the incoming
+   *   component should be dropped. */
+  bool shed();
+
+  /** @return The current time in microseconds, from an arbitrary epoch. */
+  static boost::int64_t micros()
+  {
+    return boost::chrono::duration_cast<boost::chrono::microseconds>(
+      boost::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /** Tracks a producer blocked on a full queue for the lifetime of this
+   * object, so that stats() can include waits that are still in progress.
+   * TRICKY: Must be constructed and destroyed with the queue lock held.
+   */
+  class wait_timer
+  {
+  public:
+    explicit wait_timer(shared_proc_node & node)
+    : m_node(node), m_start(micros())
+    {
+      ++m_node.m_waiting;
+      m_node.m_waitStartSum += m_start;
+    }
+
+    ~wait_timer()
+    {
+      --m_node.m_waiting;
+      m_node.m_waitStartSum -= m_start;
+      ++m_node.m_stats.blockedEnqueues;
+      m_node.m_blockedMicros += micros() - m_start;
+    }
+
+  private:
+    shared_proc_node & m_node;
+    boost::int64_t const m_start;
+  };
+
   /** Mutex for synchronizing access to the remove and inputs queue. */
   mutable mutex_t m_mutex;
-  /** Queue empty/full condition. */
-  cond_t m_cond;
+  /** Signalled when an input component arrives. */
+  cond_t m_notEmpty;
+  /** Signalled when room is made in the queue for blocked producers. */
+  cond_t m_notFull;
+  /** Load counters. */
+  queue_stats m_stats;
+  /** true indicates visit() measures visit latency. */
+  bool m_timeVisits;
+  /** Completed blocked time, less what stats() already reported as in
+   * progress. */
+  boost::int64_t m_blockedMicros;
+  /** Number of producers currently blocked, and the sum of their start
+   * times. */
+  boost::int64_t m_waiting;
+  boost::int64_t m_waitStartSum;
+  /** Overload (load shedding) settings and counters. */
+  overload_policy m_overloadPolicy;
+  boost::function<int (const Input_T &)> m_priority;
+  boost::array<size_t, NUM_OVERLOAD_POLICIES> m_drops;
+  /** Random source for drop_sampled. */
+  boost::random::mt19937 m_random;
+
+  /** The cardinality of the input tuple. */
+  static size_t const CARDINALITY =
+    boost::fusion::result_of::size<Input_T>::type::value;
+  /** Per-input count of components accepted or discarded; the k-th
+   * component of every input belongs to input set k. */
+  boost::array<boost::uint64_t, CARDINALITY> m_arrivals;
+  /** Input sets dropped before all their components arrived. */
+  std::set<boost::uint64_t> m_droppedSets;
 
 };
 
@@ -98,10 +340,24 @@ template<typename Derived_T, typename Input_T, typename Output_T>
 shared_proc_node<Derived_T, Input_T, Output_T>::
 shared_proc_node(size_t maxQueueSize)
 :
-  proc_node(maxQueueSize),
+  proc_node<Derived_T, Input_T, Output_T>(maxQueueSize),
   m_mutex(),
-  m_cond()
+  m_notEmpty(),
+  m_notFull(),
+  m_stats(),
+  m_timeVisits(false),
+  m_blockedMicros(0),
+  m_waiting(0),
+  m_waitStartSum(0),
+  m_overloadPolicy(block_producer),
+  m_priority(),
+  m_drops(),
+  m_random(),
+  m_arrivals(),
+  m_droppedSets()
 {
+  m_drops.assign(0);
+  m_arrivals.assign(0);
 }
 
 //------------------------------------------------------------------------------
@@ -111,7 +367,7 @@ maxQueueSize() const
 {
   // TRICKY: The input queue is a shared resource, so synchronize access.
   mutex_t::scoped_lock l(m_mutex);
-  return proc_node::maxQueueSize();
+  return proc_node<Derived_T, Input_T, Output_T>::maxQueueSize();
 }
 
 //------------------------------------------------------------------------------
@@ -121,7 +377,10 @@ maxQueueSize(size_t size)
 {
   // TRICKY: The input queue is a shared resource, so synchronize access.
   mutex_t::scoped_lock l(m_mutex);
-  proc_node::maxQueueSize(size);
+  proc_node<Derived_T, Input_T, Output_T>::maxQueueSize(size);
+
+  // Wake any producers blocked on the old limit.
+  m_notFull.notify_all();
 }
 
 //------------------------------------------------------------------------------
@@ -130,7 +389,7 @@ size_t shared_proc_node<Derived_T, Input_T, Output_T>::queueSize() const
 {
   // TRICKY: The input queue is a shared resource, so synchronize access.
   mutex_t::scoped_lock l(m_mutex);
-  return proc_node::queueSize();
+  return proc_node<Derived_T, Input_T, Output_T>::queueSize();
 }
 
 //------------------------------------------------------------------------------
@@ -139,7 +398,7 @@ bool shared_proc_node<Derived_T, Input_T, Output_T>::is_ready() const
 {
   // TRICKY: The input queue is a shared resource, so synchronize access.
   mutex_t::scoped_lock l(m_mutex);
-  return proc_node::is_ready();
+  return proc_node<Derived_T, Input_T, Output_T>::is_ready();
 }
 
 //------------------------------------------------------------------------------
@@ -148,7 +407,152 @@ Output_T shared_proc_node<Derived_T, Input_T, Output_T>::visit()
 {
   // TRICKY: The inputs queue is a shared resource, so synchronize access.
   mutex_t::scoped_lock l(m_mutex);
-  return proc_node::visit();
+
+  boost::int64_t const start = m_timeVisits ? micros() : 0;
+  Output_T output = proc_node<Derived_T, Input_T, Output_T>::visit();
+
+  ++m_stats.visits;
+  if (m_timeVisits)
+    m_stats.visitMicros += micros() - start;
+
+  // Wake producers blocked on the room this visit made.
+  // TRICKY: Wake them all, since the queue is full per input (see full()) and
+  //   notify_one() could wake a producer whose input is still full.
+  if (m_waiting)
+    m_notFull.notify_all();
+
+  return output;
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+queue_stats shared_proc_node<Derived_T, Input_T, Output_T>::stats(bool reset)
+{
+  // TRICKY: The counters are updated under the queue lock.
+  mutex_t::scoped_lock l(m_mutex);
+
+  boost::int64_t const inProgress = m_waiting * micros() - m_waitStartSum;
+
+  queue_stats stats = m_stats;
+  stats.blockedMicros = m_blockedMicros + inProgress;
+  if (reset)
+  {
+    // In-progress waits are added in full when they complete, so subtract
+    // the portion that has just been reported.
+    m_stats = queue_stats();
+    m_blockedMicros = -inProgress;
+  }
+  return stats;
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+bool shared_proc_node<Derived_T, Input_T, Output_T>::timeVisits() const
+{
+  mutex_t::scoped_lock l(m_mutex);
+  return m_timeVisits;
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+void shared_proc_node<Derived_T, Input_T, Output_T>::timeVisits(bool on)
+{
+  mutex_t::scoped_lock l(m_mutex);
+  m_timeVisits = on;
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+overload_policy shared_proc_node<Derived_T, Input_T, Output_T>::
+overloadPolicy() const
+{
+  mutex_t::scoped_lock l(m_mutex);
+  return m_overloadPolicy;
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+void shared_proc_node<Derived_T, Input_T, Output_T>::
+overloadPolicy(overload_policy policy)
+{
+  mutex_t::scoped_lock l(m_mutex);
+  m_overloadPolicy = policy;
+
+  // Producers blocked under block_producer must now shed instead.
+  m_notFull.notify_all();
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+void shared_proc_node<Derived_T, Input_T, Output_T>::
+priority(const boost::function<int (const Input_T &)> & priority)
+{
+  mutex_t::scoped_lock l(m_mutex);
+  m_priority = priority;
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+size_t shared_proc_node<Derived_T, Input_T, Output_T>::
+drops(overload_policy policy) const
+{
+  mutex_t::scoped_lock l(m_mutex);
+  return m_drops[policy];
+}
+
+//------------------------------------------------------------------------------
+template<typename Derived_T, typename Input_T, typename Output_T>
+bool shared_proc_node<Derived_T, Input_T, Output_T>::shed()
+{
+  // TRICKY: Called from enqueue() with the lock held.
+  ++m_drops[m_overloadPolicy];
+
+  size_t const ready = this->readyCount();
+  if (! ready)
+    return false;
+
+  switch (m_overloadPolicy)
+  {
+  case drop_oldest:
+    this->erase(0);
+    return true;
+
+  case drop_sampled:
+  {
+    // ready indicates the incoming component.
+    boost::random::uniform_int_distribution<size_t> pick(0, ready);
+    size_t const victim = pick(m_random);
+    if (victim == ready)
+      return false;
+
+    this->erase(victim);
+    return true;
+  }
+
+  case drop_lowest_priority:
+  {
+    if (! m_priority)
+      return false;
+
+    size_t victim = 0;
+    int lowest = m_priority(this->inputQueue()[0]);
+    for (size_t i = 1; i < ready; ++i)
+    {
+      int const p = m_priority(this->inputQueue()[i]);
+      if (p < lowest)
+      {
+        lowest = p;
+        victim = i;
+      }
+    }
+
+    this->erase(victim);
+    return true;
+  }
+
+  default:
+    return false;
+  }
 }
 
 #endif
@@ -0,0 +1,115 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#define BOOST_TEST_MODULE CONCURRENT_PROC_NODE_TEST
+#include <boost/test/unit_test.hpp>
+
+#include "concurrent_proc_node.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/vector.hpp>
+#include <boost/thread.hpp>
+
+#include <string>
+
+//==============================================================================
+template<typename Input_T, typename Output_T>
+class my_concurrent_node
+: public concurrent_proc_node<my_concurrent_node<Input_T, Output_T>,
+                              Input_T, Output_T>
+{
+public:
+  explicit my_concurrent_node(size_t maxQueueSize = 1024)
+  : concurrent_proc_node<my_concurrent_node, Input_T, Output_T>(maxQueueSize)
+  {}
+
+  Output_T visit_impl()
+  { return this->input(); }
+};
+
+//==============================================================================
+template<typename T1, typename T2>
+void check_output(const T1 & lhs, const T2 & rhs)
+{
+  BOOST_CHECK_EQUAL(boost::fusion::at_c<0>(lhs),
+                    boost::fusion::at_c<0>(rhs));
+  BOOST_CHECK_EQUAL(boost::fusion::at_c<1>(lhs),
+                    boost::fusion::at_c<1>(rhs));
+  BOOST_CHECK_EQUAL(boost::fusion::at_c<2>(lhs),
+                    boost::fusion::at_c<2>(rhs));
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_proc_node_basic_tests)
+{
+  typedef boost::fusion::vector<int, char, std::string> vector_t;
+  vector_t input1(1, 'x', "howdy");
+  vector_t input2(2, 'y', "pardner");
+
+  my_concurrent_node<vector_t, vector_t> node(2);
+  BOOST_CHECK_EQUAL(false, node.is_ready());
+  BOOST_CHECK_THROW(node.visit(), std::runtime_error);
+
+  node.enqueue<0>(1);
+  node.enqueue<1>('x');
+  node.enqueue<1>('y');
+  BOOST_CHECK_EQUAL(false, node.is_ready());
+  BOOST_CHECK_EQUAL(false, node.enqueue<1>('z')); // Port 1 is full.
+
+  node.enqueue<2>(std::string("howdy"));
+  BOOST_CHECK_EQUAL(true, node.is_ready());
+  BOOST_CHECK_EQUAL(1u, node.queueSize());
+  check_output(input1, node.visit());
+  BOOST_CHECK_EQUAL(false, node.is_ready());
+
+  node.enqueue<2>(std::string("pardner"));
+  node.enqueue<0>(2);
+  BOOST_CHECK_EQUAL(true, node.is_ready());
+  check_output(input2, node.visit());
+  BOOST_CHECK_EQUAL(0u, node.queueSize());
+}
+
+//------------------------------------------------------------------------------
+typedef boost::fusion::vector<int, int, int, int> four_t;
+typedef my_concurrent_node<four_t, four_t> join_t;
+
+template<size_t N>
+void produce(join_t * node, int count)
+{
+  for (int i = 0; i < count; ++i)
+  {
+    while (! node->enqueue<N>(i * 4 + int(N)))
+      boost::this_thread::yield();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_proc_node_thread_tests)
+{
+  int const COUNT = 100000;
+  join_t node(64);
+
+  boost::thread_group producers;
+  producers.create_thread(boost::bind(& produce<0>, & node, COUNT));
+  producers.create_thread(boost::bind(& produce<1>, & node, COUNT));
+  producers.create_thread(boost::bind(& produce<2>, & node, COUNT));
+  producers.create_thread(boost::bind(& produce<3>, & node, COUNT));
+
+  int errors = 0;
+  for (int i = 0; i < COUNT; ++i)
+  {
+    while (! node.is_ready())
+      boost::this_thread::yield();
+
+    four_t const out = node.visit();
+    errors += (boost::fusion::at_c<0>(out) != i * 4) +
+              (boost::fusion::at_c<1>(out) != i * 4 + 1) +
+              (boost::fusion::at_c<2>(out) != i * 4 + 2) +
+              (boost::fusion::at_c<3>(out) != i * 4 + 3);
+  }
+
+  producers.join_all();
+  BOOST_CHECK_EQUAL(0, errors);
+  BOOST_CHECK_EQUAL(false, node.is_ready());
+}
@@ -0,0 +1,504 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#define BOOST_TEST_MODULE GRAPH_EXECUTOR_TEST
+#include <boost/test/unit_test.hpp>
+
+#include "graph_executor.hpp"
+
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/vector.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+//==============================================================================
+typedef boost::fusion::vector<int>      single_t;
+typedef boost::fusion::vector<int, int> pair_t;
+
+/** Fans its input out to two output components. */
+class split_node : public proc_node<split_node, single_t, pair_t>
+{
+public:
+  explicit split_node(size_t maxQueueSize = 0)
+  : proc_node<split_node, single_t, pair_t>(maxQueueSize) {}
+
+  pair_t visit_impl()
+  {
+    int const v = boost::fusion::at_c<0>(this->inputQueue().front());
+    return pair_t(v, v);
+  }
+};
+
+/** Multiplies its input by a constant. */
+class scale_node : public proc_node<scale_node, single_t, single_t>
+{
+public:
+  explicit scale_node(int factor, size_t maxQueueSize = 0)
+  : proc_node<scale_node, single_t, single_t>(maxQueueSize), m_factor(factor) {}
+
+  single_t visit_impl()
+  { return single_t(boost::fusion::at_c<0>(this->inputQueue().front()) * m_factor); }
+
+private:
+  int m_factor;
+};
+
+/** Adds its two input components. */
+class join_node : public proc_node<join_node, pair_t, single_t>
+{
+public:
+  explicit join_node(size_t maxQueueSize = 0)
+  : proc_node<join_node, pair_t, single_t>(maxQueueSize) {}
+
+  single_t visit_impl()
+  {
+    const pair_t & in = this->inputQueue().front();
+    return single_t(boost::fusion::at_c<0>(in) + boost::fusion::at_c<1>(in));
+  }
+};
+
+struct collector
+{
+  void operator()(const single_t & output)
+  { values->push_back(boost::fusion::at_c<0>(output)); }
+
+  std::vector<int> * values;
+};
+
+BOOST_AUTO_TEST_CASE(graph_executor_diamond_tests)
+{
+  //        +-> x2 --+
+  // split -|        |-> join -> sink
+  //        +-> x3 --+
+  split_node split;
+  scale_node twice(2);
+  scale_node thrice(3);
+  join_node  join;
+  std::vector<int> results;
+  collector sink = { & results };
+
+  graph_executor exec;
+  // Register out of order; prepare() must still visit upstream first.
+  exec.connect<0, 1>(thrice, join);
+  exec.connect<0, 0>(twice, join);
+  exec.connect<0, 0>(split, twice);
+  exec.connect<1, 0>(split, thrice);
+  exec.sink(join, boost::function<void (const single_t &)>(sink));
+  BOOST_CHECK_EQUAL(4u, exec.size());
+
+  BOOST_CHECK_EQUAL(0u, exec.run());
+
+  for (int i = 1; i <= 3; ++i)
+    split.enqueue<0>(i);
+
+  BOOST_CHECK_EQUAL(12u, exec.run());
+  BOOST_REQUIRE_EQUAL(3u, results.size());
+  BOOST_CHECK_EQUAL(5, results[0]);
+  BOOST_CHECK_EQUAL(10, results[1]);
+  BOOST_CHECK_EQUAL(15, results[2]);
+  BOOST_CHECK_EQUAL(false, join.is_ready());
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_backpressure_tests)
+{
+  scale_node first(1);
+  scale_node second(10, 1 /* maxQueueSize */);
+  std::vector<int> results;
+  collector sink = { & results };
+
+  graph_executor exec;
+  exec.connect<0, 0>(first, second);
+  exec.sink(second, boost::function<void (const single_t &)>(sink));
+
+  for (int i = 1; i <= 5; ++i)
+    first.enqueue<0>(i);
+
+  // The single-slot queue holds first back, but nothing is lost.
+  BOOST_CHECK_EQUAL(10u, exec.run());
+  BOOST_REQUIRE_EQUAL(5u, results.size());
+  for (int i = 0; i < 5; ++i)
+    BOOST_CHECK_EQUAL((i + 1) * 10, results[i]);
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_bounded_join_tests)
+{
+  // A full join queue must still accept the missing half of its last set.
+  split_node split;
+  scale_node twice(2);
+  scale_node thrice(3);
+  join_node  join(1 /* maxQueueSize */);
+  std::vector<int> results;
+  collector sink = { & results };
+
+  graph_executor exec;
+  exec.connect<0, 0>(split, twice);
+  exec.connect<1, 0>(split, thrice);
+  exec.connect<0, 0>(twice, join);
+  exec.connect<0, 1>(thrice, join);
+  exec.sink(join, boost::function<void (const single_t &)>(sink));
+
+  for (int i = 1; i <= 3; ++i)
+    split.enqueue<0>(i);
+
+  BOOST_CHECK_EQUAL(12u, exec.run());
+  BOOST_REQUIRE_EQUAL(3u, results.size());
+  BOOST_CHECK_EQUAL(15, results[2]);
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_cycle_tests)
+{
+  scale_node a(1);
+  scale_node b(1);
+
+  graph_executor exec;
+  exec.connect<0, 0>(a, b);
+  exec.connect<0, 0>(b, a);
+  BOOST_CHECK_THROW(exec.prepare(), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_reconfigure_tests)
+{
+  scale_node first(1);
+  scale_node twice(2);
+  scale_node tenfold(10);
+  std::vector<int> results;
+  collector sink = { & results };
+
+  graph_executor exec;
+  exec.connect<0, 0>(first, twice);
+  exec.sink(twice, boost::function<void (const single_t &)>(sink));
+
+  first.enqueue<0>(1);
+  BOOST_CHECK_EQUAL(2u, exec.run());
+  BOOST_CHECK_EQUAL(1u, exec.epoch());
+
+  // Edits are staged until published.
+  exec.replace(twice, tenfold);
+  BOOST_CHECK_EQUAL(1u, exec.epoch());
+  BOOST_CHECK_EQUAL(2u, exec.prepare());
+  BOOST_CHECK_THROW(exec.replace(twice, tenfold), std::invalid_argument);
+
+  first.enqueue<0>(1);
+  BOOST_CHECK_EQUAL(2u, exec.run());
+
+  // Bypass tenfold, then drop it.
+  BOOST_CHECK_EQUAL(1u, (exec.disconnect<0, 0>(first, tenfold)));
+  BOOST_CHECK_EQUAL(0u, (exec.disconnect<0, 0>(first, tenfold)));
+  exec.sink(first, boost::function<void (const single_t &)>(sink));
+  BOOST_CHECK(exec.remove(tenfold));
+  BOOST_CHECK(! exec.remove(tenfold));
+  BOOST_CHECK_EQUAL(1u, exec.size());
+
+  first.enqueue<0>(1);
+  BOOST_CHECK_EQUAL(1u, exec.run());
+  BOOST_CHECK_EQUAL(3u, exec.epoch());
+
+  BOOST_REQUIRE_EQUAL(3u, results.size());
+  BOOST_CHECK_EQUAL(2, results[0]);
+  BOOST_CHECK_EQUAL(10, results[1]);
+  BOOST_CHECK_EQUAL(1, results[2]);
+}
+
+//------------------------------------------------------------------------------
+/** Swaps the downstream stage the first time it is visited, i.e. while the
+ * executor is in the middle of a run. */
+class switch_node : public proc_node<switch_node, single_t, single_t>
+{
+public:
+  switch_node(graph_executor & exec, scale_node & from, scale_node & to)
+  : proc_node<switch_node, single_t, single_t>(),
+    m_exec(exec), m_from(from), m_to(to), m_switched(false), m_waiter(),
+    m_waited(false)
+  {}
+
+  ~switch_node() { m_waiter.join(); }
+
+  single_t visit_impl()
+  {
+    if (! m_switched)
+    {
+      m_switched = true;
+      m_exec.replace(m_from, m_to);
+      size_t const epoch = m_exec.prepare();
+      m_waiter = boost::thread(& switch_node::wait, this, epoch);
+    }
+    return this->inputQueue().front();
+  }
+
+  bool waited() const { return m_waited; }
+
+  void join() { m_waiter.join(); }
+
+private:
+  void wait(size_t epoch)
+  {
+    m_exec.wait_for_epoch(epoch);
+    m_waited = true;
+  }
+
+  graph_executor & m_exec;
+  scale_node & m_from;
+  scale_node & m_to;
+  bool m_switched;
+  boost::thread m_waiter;
+  boost::atomic<bool> m_waited;
+};
+
+BOOST_AUTO_TEST_CASE(graph_executor_epoch_handoff_tests)
+{
+  graph_executor exec;
+  scale_node twice(2);
+  scale_node tenfold(10);
+  switch_node first(exec, twice, tenfold);
+  std::vector<int> results;
+  collector sink = { & results };
+
+  exec.connect<0, 0>(first, twice);
+  exec.sink(twice, boost::function<void (const single_t &)>(sink));
+  exec.prepare();
+
+  for (int i = 1; i <= 3; ++i)
+    first.enqueue<0>(i);
+
+  // The switch is published mid-run; tuples already in flight still finish
+  // on the old topology.
+  BOOST_CHECK_EQUAL(6u, exec.run());
+  BOOST_CHECK_EQUAL(2u, exec.epoch());
+
+  // The next run() hands off twice's (empty) queue, releasing the waiter.
+  first.enqueue<0>(4);
+  BOOST_CHECK_EQUAL(2u, exec.run());
+  first.join();
+  BOOST_CHECK(first.waited());
+
+  BOOST_REQUIRE_EQUAL(4u, results.size());
+  BOOST_CHECK_EQUAL(2, results[0]);
+  BOOST_CHECK_EQUAL(4, results[1]);
+  BOOST_CHECK_EQUAL(6, results[2]);
+  BOOST_CHECK_EQUAL(40, results[3]);
+  BOOST_CHECK_EQUAL(false, twice.is_ready());
+}
+
+//------------------------------------------------------------------------------
+void edit_concurrently(graph_executor * exec, scale_node * from,
+                       scale_node * to, boost::barrier * step)
+{
+  graph_executor::edit_scope scope(*exec);
+  exec->replace(*from, *to);
+  step->wait();  // Edits staged.
+  step->wait();  // run() has made its pass.
+  exec->prepare();
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_edit_scope_tests)
+{
+  scale_node first(1);
+  scale_node twice(2);
+  scale_node tenfold(10);
+  std::vector<int> results;
+  collector sink = { & results };
+
+  graph_executor exec;
+  exec.connect<0, 0>(first, twice);
+  exec.sink(twice, boost::function<void (const single_t &)>(sink));
+
+  boost::barrier step(2);
+  boost::thread editor(& edit_concurrently, & exec, & twice, & tenfold,
+                       & step);
+  step.wait();
+
+  // Nothing was published yet, and the open scope holds the edits back.
+  first.enqueue<0>(1);
+  BOOST_CHECK_EQUAL(0u, exec.run());
+  BOOST_CHECK_EQUAL(0u, exec.epoch());
+
+  step.wait();
+  editor.join();
+  BOOST_CHECK_EQUAL(1u, exec.epoch());
+  BOOST_CHECK_EQUAL(2u, exec.run());
+
+  BOOST_REQUIRE_EQUAL(1u, results.size());
+  BOOST_CHECK_EQUAL(10, results[0]);
+}
+
+//------------------------------------------------------------------------------
+/** Blocks its first visit until released, holding a run() open. */
+class gate_node : public proc_node<gate_node, single_t, single_t>
+{
+public:
+  gate_node()
+  : proc_node<gate_node, single_t, single_t>(), m_step(2), m_held(false) {}
+
+  single_t visit_impl()
+  {
+    if (! m_held)
+    {
+      m_held = true;
+      m_step.wait();  // Entered.
+      m_step.wait();  // Released.
+    }
+    return this->inputQueue().front();
+  }
+
+  boost::barrier & step() { return m_step; }
+
+private:
+  boost::barrier m_step;
+  bool m_held;
+};
+
+void run_executor(graph_executor * exec, size_t * visits)
+{ *visits = exec->run(); }
+
+void wait_epoch(graph_executor * exec, size_t epoch, boost::atomic<bool> * done)
+{
+  exec->wait_for_epoch(epoch);
+  *done = true;
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_wait_for_epoch_tests)
+{
+  gate_node gate;
+  scale_node * const twice = new scale_node(2);
+  scale_node tenfold(10);
+  std::vector<int> results;
+  collector sink = { & results };
+
+  graph_executor exec;
+  exec.connect<0, 0>(gate, *twice);
+  exec.sink(*twice, boost::function<void (const single_t &)>(sink));
+  exec.prepare();
+
+  // Hold a run() open on another thread, then replace a node it will use.
+  gate.enqueue<0>(1);
+  size_t visits = 0;
+  boost::thread runner(& run_executor, & exec, & visits);
+  gate.step().wait();
+
+  exec.replace(*twice, tenfold);
+  size_t const epoch = exec.prepare();
+  boost::atomic<bool> done(false);
+  boost::thread waiter(& wait_epoch, & exec, epoch, & done);
+
+  boost::this_thread::sleep_for(boost::chrono::milliseconds(20));
+  BOOST_CHECK_EQUAL(false, done.load());
+
+  gate.step().wait();
+  runner.join();
+  BOOST_CHECK_EQUAL(2u, visits);
+
+  // The hand-off is still pending until the next run().
+  BOOST_CHECK_EQUAL(false, done.load());
+  BOOST_CHECK_EQUAL(0u, exec.run());
+  waiter.join();
+  BOOST_CHECK(done.load());
+
+  // Nothing references the replaced node any more.
+  delete twice;
+  gate.enqueue<0>(2);
+  BOOST_CHECK_EQUAL(2u, exec.run());
+
+  BOOST_REQUIRE_EQUAL(2u, results.size());
+  BOOST_CHECK_EQUAL(2, results[0]);
+  BOOST_CHECK_EQUAL(20, results[1]);
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_replace_join_tests)
+{
+  scale_node left(1);
+  scale_node right(1);
+  join_node  join;
+  join_node  replacement;
+  std::vector<int> results;
+  collector sink = { & results };
+
+  graph_executor exec;
+  exec.connect<0, 0>(left, join);
+  exec.connect<0, 1>(right, join);
+  exec.sink(join, boost::function<void (const single_t &)>(sink));
+
+  // Leave join with a half-filled set.
+  left.enqueue<0>(1);
+  left.enqueue<0>(2);
+  right.enqueue<0>(10);
+  BOOST_CHECK_EQUAL(4u, exec.run());
+  BOOST_CHECK_EQUAL(1u, join.queueSize());
+
+  exec.replace(join, replacement);
+  exec.prepare();
+
+  // Components enqueued straight into join before the hand-off also move.
+  join.enqueue<0>(3);
+  right.enqueue<0>(20);
+  right.enqueue<0>(30);
+  BOOST_CHECK_EQUAL(4u, exec.run());
+  BOOST_CHECK_EQUAL(0u, join.queueSize());
+  BOOST_CHECK_EQUAL(0u, replacement.queueSize());
+
+  BOOST_REQUIRE_EQUAL(3u, results.size());
+  BOOST_CHECK_EQUAL(11, results[0]);
+  BOOST_CHECK_EQUAL(22, results[1]);
+  BOOST_CHECK_EQUAL(33, results[2]);
+}
+
+//------------------------------------------------------------------------------
+struct counter
+{
+  void operator()(const single_t &) { ++*count; }
+  size_t * count;
+};
+
+void feed_and_run(graph_executor * exec, scale_node * source,
+                  boost::atomic<bool> * stop, size_t * fed)
+{
+  while (! *stop)
+  {
+    source->enqueue<0>(1);
+    ++*fed;
+    exec->run();
+  }
+  exec->run();
+}
+
+BOOST_AUTO_TEST_CASE(graph_executor_remove_stress_tests)
+{
+  scale_node source(1);
+  scale_node * middle = new scale_node(1);
+  size_t count = 0;
+  counter sink = { & count };
+  boost::function<void (const single_t &)> const f(sink);
+
+  graph_executor exec;
+  exec.connect<0, 0>(source, *middle);
+  exec.sink(*middle, f);
+  exec.prepare();
+
+  // Swap out and free the middle node over and over while every run() on
+  // the other thread may be pinning the graph that still uses it.  remove()
+  // hands nothing off, so only the pin protects the node.
+  boost::atomic<bool> stop(false);
+  size_t fed = 0;
+  boost::thread runner(& feed_and_run, & exec, & source, & stop, & fed);
+  for (int i = 0; i < 500; ++i)
+  {
+    scale_node * const next = new scale_node(1);
+    {
+      graph_executor::edit_scope scope(exec);
+      exec.remove(*middle);
+      exec.connect<0, 0>(source, *next);
+      exec.sink(*next, f);
+    }
+    exec.wait_for_epoch(exec.prepare());
+    delete middle;
+    middle = next;
+  }
+  stop = true;
+  runner.join();
+
+  // Inputs still queued in a removed node are left behind.
+  BOOST_CHECK(count <= fed);
+  delete middle;
+}
@@ -0,0 +1,156 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#define BOOST_TEST_MODULE LATENCY_HARNESS_TEST
+#include <boost/test/unit_test.hpp>
+
+#include "latency_harness.hpp"
+
+#include <boost/bind.hpp>
+
+//==============================================================================
+BOOST_AUTO_TEST_CASE(latency_histogram_tests)
+{
+  latency_histogram h(7);
+  BOOST_CHECK_EQUAL(0u, h.count());
+  BOOST_CHECK_EQUAL(0u, h.percentile(99.0));
+
+  // Small values are exact.
+  for (latency_histogram::value_t v = 1; v <= 100; ++v)
+    h.record(v);
+  BOOST_CHECK_EQUAL(100u, h.count());
+  BOOST_CHECK_EQUAL(1u, h.min());
+  BOOST_CHECK_EQUAL(100u, h.max());
+  BOOST_CHECK_EQUAL(50u, h.percentile(50.0));
+  BOOST_CHECK_EQUAL(99u, h.percentile(99.0));
+  BOOST_CHECK_EQUAL(100u, h.percentile(100.0));
+  BOOST_CHECK_CLOSE(50.5, h.mean(), 1e-9);
+
+  // Large values are within the relative precision: 2^-6 for 7 bits.
+  h.reset();
+  h.record(1000000);
+  h.record(1);
+  latency_histogram::value_t const p = h.percentile(100.0);
+  BOOST_CHECK_EQUAL(1000000u, p); // Clamped to the recorded max.
+  h.record(2000000);
+  BOOST_CHECK(h.percentile(60.0) >= 1000000u);
+  BOOST_CHECK(h.percentile(60.0) <= 1000000u + 1000000u / 64);
+}
+
+BOOST_AUTO_TEST_CASE(latency_histogram_merge_tests)
+{
+  latency_histogram h;
+  h.record(10000, 9);
+  h.record(1000);
+  BOOST_CHECK_EQUAL(10u, h.count());
+  BOOST_CHECK_EQUAL(1000u, h.min());
+  BOOST_CHECK_EQUAL(10000u, h.max());
+
+  latency_histogram other;
+  other.record(500);
+  h.merge(other);
+  BOOST_CHECK_EQUAL(11u, h.count());
+  BOOST_CHECK_EQUAL(500u, h.min());
+  BOOST_CHECK_EQUAL(10000u, h.percentile(50.0));
+}
+
+BOOST_AUTO_TEST_CASE(arrival_process_tests)
+{
+  arrival_process constant(arrival_process::constant, 1000.0);
+  BOOST_CHECK_CLOSE(1e6, constant.next_interval(), 1e-9);
+
+  arrival_process poisson(arrival_process::poisson, 1000.0);
+  double total = 0.0;
+  for (int i = 0; i < 100000; ++i)
+    total += poisson.next_interval();
+  BOOST_CHECK_CLOSE(1e6, total / 100000, 2.0);
+}
+
+//------------------------------------------------------------------------------
+void complete_after(open_loop_harness * harness, unsigned micros, size_t id)
+{
+  boost::this_thread::sleep_for(boost::chrono::microseconds(micros));
+  harness->complete(id);
+}
+
+BOOST_AUTO_TEST_CASE(open_loop_harness_tests)
+{
+  // Arrivals every 1ms; a synchronous 100us service time keeps up.
+  open_loop_harness harness(
+    arrival_process(arrival_process::constant, 1000.0), 50);
+  load_result const fast = harness.run(
+    boost::bind(& complete_after, & harness, 100u, _1));
+  BOOST_CHECK_EQUAL(50u, fast.completed);
+  BOOST_CHECK(fast.latency.percentile(50.0) >= 100000u);
+  BOOST_CHECK(fast.latency.percentile(50.0) < 1000000u);
+
+  // A 3ms service time falls behind, and the queueing delay is charged even
+  // though each call itself only takes 3ms.
+  load_result const slow = harness.run(
+    boost::bind(& complete_after, & harness, 3000u, _1));
+  BOOST_CHECK_EQUAL(50u, slow.completed);
+  BOOST_CHECK(slow.latency.max() > 50000000u);
+  BOOST_CHECK(slow.achievedRate < 0.95 * slow.offeredRate);
+}
+
+//------------------------------------------------------------------------------
+void complete_later(boost::thread_group * threads,
+                    open_loop_harness * harness, unsigned micros, size_t id)
+{ threads->create_thread(boost::bind(& complete_after, harness, micros, id)); }
+
+BOOST_AUTO_TEST_CASE(open_loop_harness_stale_tests)
+{
+  // Arrivals every 10ms, so each run takes about 100ms.
+  open_loop_harness harness(
+    arrival_process(arrival_process::constant, 100.0), 10);
+  boost::thread_group threads;
+
+  // Completions 150ms late miss the 1ms drain timeout, and the first few
+  // arrive while the next run is in progress.  Charged to the tuples of the
+  // next run with the same index, they would add about 50ms.
+  load_result const timedOut = harness.run(
+    boost::bind(& complete_later, & threads, & harness, 150000u, _1), 1);
+  BOOST_CHECK_EQUAL(10u, timedOut.sent);
+  BOOST_CHECK(timedOut.completed < 10u);
+
+  load_result const next = harness.run(
+    boost::bind(& complete_after, & harness, 100u, _1));
+  threads.join_all();
+  BOOST_CHECK_EQUAL(10u, next.completed);
+  BOOST_CHECK(next.stale > 0u);
+  BOOST_CHECK(next.latency.max() < 25000000u);
+
+  // Completions after run() has returned, or for ids never sent, are
+  // ignored.
+  harness.complete(0);
+  harness.complete(1000);
+}
+
+//------------------------------------------------------------------------------
+void complete_at_two_sinks(boost::thread_group * threads,
+                           open_loop_harness * harness, size_t id)
+{
+  // One sink completes at once, the other 30ms later, while later tuples are
+  // still being sent.
+  harness->complete(id);
+  complete_later(threads, harness, 30000u, id);
+}
+
+BOOST_AUTO_TEST_CASE(open_loop_harness_fan_out_tests)
+{
+  // Arrivals every 10ms, so the run takes about 100ms.
+  open_loop_harness harness(
+    arrival_process(arrival_process::constant, 100.0), 10);
+  boost::thread_group threads;
+
+  load_result const r = harness.run(
+    boost::bind(& complete_at_two_sinks, & threads, & harness, _1));
+  threads.join_all();
+  BOOST_CHECK_EQUAL(10u, r.sent);
+  BOOST_CHECK_EQUAL(10u, r.completed);
+  BOOST_CHECK_EQUAL(10u, r.latency.count());
+  BOOST_CHECK(r.duplicates > 0u);
+  BOOST_CHECK(r.latency.max() < 20000000u);
+}
@@ -0,0 +1,153 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#define BOOST_TEST_MODULE LAZY_PROC_NODE_TEST
+#include <boost/test/unit_test.hpp>
+
+#include "lazy_proc_node.hpp"
+
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/vector.hpp>
+
+//==============================================================================
+typedef boost::fusion::vector<int, int> pair_t;
+typedef boost::fusion::vector<int>      single_t;
+
+class sum_node : public lazy_proc_node<sum_node, pair_t, single_t>
+{
+public:
+  sum_node() : m_visits(0) {}
+
+  single_t visit_impl()
+  {
+    ++m_visits;
+    return single_t(boost::fusion::at_c<0>(this->input()) +
+                    boost::fusion::at_c<1>(this->input()));
+  }
+
+  size_t visits() const { return m_visits; }
+
+private:
+  size_t m_visits;
+};
+
+class scale_node : public lazy_proc_node<scale_node, single_t, single_t>
+{
+public:
+  scale_node() : m_visits(0) {}
+
+  single_t visit_impl()
+  {
+    ++m_visits;
+    return single_t(boost::fusion::at_c<0>(this->input()) * 10);
+  }
+
+  size_t visits() const { return m_visits; }
+
+private:
+  size_t m_visits;
+};
+
+BOOST_AUTO_TEST_CASE(lazy_proc_node_basic_tests)
+{
+  sum_node node;
+  BOOST_CHECK_EQUAL(false, node.is_ready());
+  BOOST_CHECK_THROW(node.value(), std::runtime_error);
+
+  node.enqueue<0>(1);
+  BOOST_CHECK_EQUAL(false, node.is_ready());
+  node.enqueue<1>(2);
+  BOOST_CHECK_EQUAL(true, node.is_ready());
+  BOOST_CHECK_EQUAL(0u, node.visits());
+
+  BOOST_CHECK_EQUAL(3, node.output<0>());
+  BOOST_CHECK_EQUAL(false, node.is_dirty());
+  BOOST_CHECK_EQUAL(3, node.output<0>());
+  BOOST_CHECK_EQUAL(1u, node.visits());
+
+  // Many updates, one read: one visit.
+  for (int i = 0; i < 100; ++i)
+    node.enqueue<0>(i);
+  BOOST_CHECK_EQUAL(true, node.is_dirty());
+  BOOST_CHECK_EQUAL(101, node.output<0>());
+  BOOST_CHECK_EQUAL(2u, node.visits());
+}
+
+BOOST_AUTO_TEST_CASE(lazy_proc_node_pull_tests)
+{
+  // (a + b) -> *10 -> sum with c
+  sum_node   first;
+  scale_node scale;
+  sum_node   last;
+  scale.source<0, 0>(first);
+  last.source<0, 0>(scale);
+
+  first.enqueue<0>(1);
+  first.enqueue<1>(2);
+  last.enqueue<1>(5);
+
+  BOOST_CHECK_EQUAL(35, last.output<0>());
+  BOOST_CHECK_EQUAL(1u, first.visits());
+  BOOST_CHECK_EQUAL(1u, scale.visits());
+  BOOST_CHECK_EQUAL(1u, last.visits());
+
+  // Updating a leaf input of the last node only recomputes the last node.
+  last.enqueue<1>(6);
+  BOOST_CHECK_EQUAL(false, first.is_dirty());
+  BOOST_CHECK_EQUAL(false, scale.is_dirty());
+  BOOST_CHECK_EQUAL(36, last.output<0>());
+  BOOST_CHECK_EQUAL(1u, first.visits());
+  BOOST_CHECK_EQUAL(1u, scale.visits());
+  BOOST_CHECK_EQUAL(2u, last.visits());
+
+  // Upstream updates propagate dirtiness without computing anything.
+  for (int i = 0; i < 10; ++i)
+    first.enqueue<0>(i);
+  BOOST_CHECK_EQUAL(true, scale.is_dirty());
+  BOOST_CHECK_EQUAL(true, last.is_dirty());
+  BOOST_CHECK_EQUAL(1u, first.visits());
+
+  BOOST_CHECK_EQUAL(116, last.output<0>());
+  BOOST_CHECK_EQUAL(2u, first.visits());
+  BOOST_CHECK_EQUAL(2u, scale.visits());
+  BOOST_CHECK_EQUAL(3u, last.visits());
+
+  // Reading an intermediate node leaves the downstream node dirty.
+  first.enqueue<1>(3);
+  BOOST_CHECK_EQUAL(120, scale.output<0>());
+  BOOST_CHECK_EQUAL(true, last.is_dirty());
+  BOOST_CHECK_EQUAL(126, last.output<0>());
+  BOOST_CHECK_EQUAL(3u, scale.visits());
+}
+
+BOOST_AUTO_TEST_CASE(lazy_proc_node_detach_tests)
+{
+  sum_node first;
+  first.enqueue<0>(1);
+  first.enqueue<1>(2);
+
+  {
+    scale_node scale;
+    scale.source<0, 0>(first);
+    // Rebinding the same port must not register a second dependent.
+    scale.source<0, 0>(first);
+    BOOST_CHECK_EQUAL(30, scale.output<0>());
+    BOOST_CHECK_EQUAL(false, first.is_dirty());
+  } // scale unregisters from first.
+
+  // first is clean, so this would invalidate the destroyed node.
+  first.enqueue<0>(2);
+  BOOST_CHECK_EQUAL(4, first.output<0>());
+
+  // Pushing to a bound port unbinds it.
+  scale_node scale;
+  scale.source<0, 0>(first);
+  scale.enqueue<0>(7);
+  BOOST_CHECK_EQUAL(70, scale.output<0>());
+  first.enqueue<0>(3);
+  BOOST_CHECK_EQUAL(false, scale.is_dirty());
+  BOOST_CHECK_EQUAL(70, scale.output<0>());
+  BOOST_CHECK_EQUAL(5, first.output<0>());
+}
@@ -0,0 +1,109 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#define BOOST_TEST_MODULE MEMO_PROC_NODE_TEST
+#include <boost/test/unit_test.hpp>
+
+#include "memo_proc_node.hpp"
+
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/vector.hpp>
+
+#include <string>
+
+//==============================================================================
+template<typename Input_T, typename Output_T,
+         template<typename, typename, typename> class Eviction_T>
+class my_memo_node
+: public memo_proc_node<my_memo_node<Input_T, Output_T, Eviction_T>,
+                        Input_T, Output_T, proc_node, Eviction_T>
+{
+public:
+  explicit my_memo_node(size_t cacheSize)
+  : memo_proc_node<my_memo_node, Input_T, Output_T, proc_node, Eviction_T>(
+      cacheSize),
+    m_calls(0)
+  {}
+
+  Output_T memo_visit_impl(const Input_T & input)
+  {
+    ++m_calls;
+    return Output_T(boost::fusion::at_c<0>(input) * 10,
+                    boost::fusion::at_c<1>(input) + "!");
+  }
+
+  size_t calls() const { return m_calls; }
+
+private:
+  size_t m_calls;
+};
+
+//==============================================================================
+template<typename Node_T>
+int run(Node_T & node, int key, const std::string & name)
+{
+  node.template enqueue<0>(key);
+  node.template enqueue<1>(name);
+  BOOST_CHECK_EQUAL(true, node.is_ready());
+  return boost::fusion::at_c<0>(node.visit());
+}
+
+BOOST_AUTO_TEST_CASE(memo_proc_node_lru_tests)
+{
+  typedef boost::fusion::vector<int, std::string> vector_t;
+  my_memo_node<vector_t, vector_t, lru_eviction> node(2);
+
+  BOOST_CHECK_EQUAL(10, run(node, 1, "a"));
+  BOOST_CHECK_EQUAL(10, run(node, 1, "a"));
+  BOOST_CHECK_EQUAL(1u, node.calls());
+  BOOST_CHECK_EQUAL(1u, node.cacheHits());
+  BOOST_CHECK_EQUAL(1u, node.cacheMisses());
+
+  // Same first component, different second: must not collide.
+  BOOST_CHECK_EQUAL(10, run(node, 1, "b"));
+  BOOST_CHECK_EQUAL(2u, node.calls());
+
+  // (1,"a") was touched less recently than (1,"b"), so it gets evicted.
+  BOOST_CHECK_EQUAL(20, run(node, 2, "a"));
+  BOOST_CHECK_EQUAL(3u, node.calls());
+  BOOST_CHECK_EQUAL(2u, node.cache().size());
+
+  run(node, 1, "b");
+  BOOST_CHECK_EQUAL(3u, node.calls());
+  run(node, 1, "a");
+  BOOST_CHECK_EQUAL(4u, node.calls());
+  BOOST_CHECK_EQUAL(2u, node.cacheHits());
+  BOOST_CHECK_EQUAL(4u, node.cacheMisses());
+}
+
+BOOST_AUTO_TEST_CASE(memo_proc_node_clock_tests)
+{
+  typedef boost::fusion::vector<int, std::string> vector_t;
+  my_memo_node<vector_t, vector_t, clock_eviction> node(2);
+
+  run(node, 1, "a");
+  run(node, 2, "a");
+  run(node, 1, "a"); // Gives (1,"a") a second chance.
+  BOOST_CHECK_EQUAL(2u, node.calls());
+
+  // The hand clears (1,"a") and evicts (2,"a").
+  run(node, 3, "a");
+  BOOST_CHECK_EQUAL(3u, node.calls());
+  BOOST_CHECK_EQUAL(2u, node.cache().size());
+
+  run(node, 1, "a");
+  BOOST_CHECK_EQUAL(3u, node.calls());
+  run(node, 2, "a");
+  BOOST_CHECK_EQUAL(4u, node.calls());
+}
+
+BOOST_AUTO_TEST_CASE(memo_cache_hash_tests)
+{
+  typedef boost::fusion::vector<int, std::string> vector_t;
+  fusion_hash<vector_t> hash;
+
+  BOOST_CHECK_EQUAL(hash(vector_t(1, "a")), hash(vector_t(1, "a")));
+  BOOST_CHECK(hash(vector_t(1, "a")) != hash(vector_t(1, "b")));
+}
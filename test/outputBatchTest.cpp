@@ -0,0 +1,159 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#define BOOST_TEST_MODULE OUTPUT_BATCH_TEST
+#include <boost/test/unit_test.hpp>
+
+#include "output_batch.hpp"
+#include "shared_proc_node.hpp"
+
+#include <boost/bind.hpp>
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/vector.hpp>
+#include <boost/thread.hpp>
+
+#include <vector>
+
+//==============================================================================
+typedef boost::fusion::vector<int, int> pair_t;
+
+class my_proc_node : public shared_proc_node<my_proc_node, pair_t, pair_t>
+{
+public:
+  explicit my_proc_node(size_t maxQueueSize = 0)
+  : shared_proc_node<my_proc_node, pair_t, pair_t>(maxQueueSize) {}
+
+  pair_t visit_impl()
+  { return this->inputQueue().front(); }
+};
+
+BOOST_AUTO_TEST_CASE(shared_proc_node_enqueue_range_tests)
+{
+  my_proc_node node(3);
+  std::vector<int> values;
+  for (int i = 0; i < 5; ++i)
+    values.push_back(i);
+
+  // Not blocking: only what fits is accepted.
+  BOOST_CHECK_EQUAL(3u, node.enqueue_range<0>(values.begin(), values.end(),
+                                              false));
+  BOOST_CHECK_EQUAL(3u, node.enqueue_range<1>(values.begin(), values.end(),
+                                              false));
+  BOOST_CHECK_EQUAL(3u, node.queueSize());
+  BOOST_CHECK_EQUAL(6u, node.stats().enqueues);
+
+  for (int i = 0; i < 3; ++i)
+  {
+    pair_t const out = node.visit();
+    BOOST_CHECK_EQUAL(i, boost::fusion::at_c<0>(out));
+    BOOST_CHECK_EQUAL(i, boost::fusion::at_c<1>(out));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(batched_edge_size_tests)
+{
+  my_proc_node node;
+  batched_edge<my_proc_node, 0, int> edge(node, 3, 1000000 /* 1s */);
+
+  BOOST_CHECK_EQUAL(0u, edge.push(1));
+  BOOST_CHECK_EQUAL(0u, edge.push(2));
+  BOOST_CHECK_EQUAL(2u, edge.size());
+  BOOST_CHECK_EQUAL(0u, node.queueSize());
+
+  BOOST_CHECK_EQUAL(3u, edge.push(3));
+  BOOST_CHECK_EQUAL(0u, edge.size());
+  BOOST_CHECK_EQUAL(3u, node.queueSize());
+  BOOST_CHECK_EQUAL(1u, edge.batches());
+
+  // Explicit flush at end of stream.
+  edge.push(4);
+  BOOST_CHECK_EQUAL(1u, edge.flush());
+  BOOST_CHECK_EQUAL(0u, edge.flush());
+  BOOST_CHECK_EQUAL(4u, node.queueSize());
+  BOOST_CHECK_EQUAL(4u, edge.published());
+  BOOST_CHECK_EQUAL(2u, edge.batches());
+}
+
+BOOST_AUTO_TEST_CASE(batched_edge_timeout_tests)
+{
+  my_proc_node node;
+  {
+    batched_edge<my_proc_node, 1, int> edge(node, 100, 2000 /* 2ms */);
+    edge.push(1);
+    BOOST_CHECK_EQUAL(0u, edge.poll());
+
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+    BOOST_CHECK_EQUAL(1u, edge.poll());
+    BOOST_CHECK_EQUAL(1u, node.queueSize());
+
+    // The next push starts a new timeout; a stale one publishes immediately.
+    edge.push(2);
+    boost::this_thread::sleep_for(boost::chrono::milliseconds(5));
+    BOOST_CHECK_EQUAL(2u, edge.push(3));
+
+    edge.push(4);
+  } // The destructor flushes.
+
+  BOOST_CHECK_EQUAL(4u, node.queueSize());
+}
+
+BOOST_AUTO_TEST_CASE(batched_edge_destructor_tests)
+{
+  // The consumer is full, so a blocking flush would wait forever.
+  my_proc_node node(1);
+  node.enqueue<0>(1);
+  node.enqueue<1>(1);
+  {
+    batched_edge<my_proc_node, 0, int> edge(node, 10, 1000000 /* 1s */);
+    edge.push(2);
+    edge.push(3);
+  } // The destructor drops what does not fit instead of blocking.
+
+  BOOST_CHECK_EQUAL(1u, node.queueSize());
+}
+
+//------------------------------------------------------------------------------
+template<int N>
+void produce_batched(my_proc_node * node, int count)
+{
+  batched_edge<my_proc_node, N, int> edge(*node, 10, 1000000 /* 1s */);
+  for (int i = 0; i < count; ++i)
+    edge.push(i);
+  edge.flush();
+}
+
+void consume(my_proc_node * node, int count, std::vector<pair_t> * outputs)
+{
+  while (int(outputs->size()) < count)
+  {
+    if (node->is_ready())
+      outputs->push_back(node->visit());
+    else
+      boost::this_thread::yield();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(batched_edge_backpressure_tests)
+{
+  // Blocking batches into a small queue only complete because each visit
+  // wakes the blocked producers.
+  my_proc_node node(2);
+  std::vector<pair_t> outputs;
+  boost::thread consumer(boost::bind(& consume, & node, 20, & outputs));
+  boost::thread first(boost::bind(& produce_batched<0>, & node, 20));
+  boost::thread second(boost::bind(& produce_batched<1>, & node, 20));
+
+  boost::posix_time::seconds const timeout(5);
+  BOOST_REQUIRE(first.timed_join(timeout));
+  BOOST_REQUIRE(second.timed_join(timeout));
+  BOOST_REQUIRE(consumer.timed_join(timeout));
+
+  for (int i = 0; i < 20; ++i)
+  {
+    BOOST_CHECK_EQUAL(i, boost::fusion::at_c<0>(outputs[i]));
+    BOOST_CHECK_EQUAL(i, boost::fusion::at_c<1>(outputs[i]));
+  }
+  BOOST_CHECK_EQUAL(0u, node.queueSize());
+}
@@ -147,3 +147,59 @@ BOOST_AUTO_TEST_CASE(proc_node_tests)
   //boost::fusion::result_of::value_of<first>::type t = std::string();
 
 }
+
+BOOST_AUTO_TEST_CASE(proc_node_bounded_queue_tests)
+{
+  typedef boost::fusion::vector<int, int> pair_t;
+  my_proc_node<pair_t, pair_t> node;
+  node.maxQueueSize(1);
+
+  // A full queue refuses a component that would start a new input set...
+  BOOST_CHECK(node.enqueue<0>(1));
+  BOOST_CHECK_EQUAL(true, node.full(0));
+  BOOST_CHECK_EQUAL(false, node.enqueue<0>(2));
+
+  // ...but still accepts the missing component of its last partial set.
+  BOOST_CHECK_EQUAL(false, node.full(1));
+  BOOST_CHECK(node.enqueue<1>(10));
+  BOOST_CHECK_EQUAL(true, node.full(1));
+  BOOST_CHECK_EQUAL(false, node.enqueue<1>(20));
+
+  pair_t const output = node.visit();
+  BOOST_CHECK_EQUAL(1, boost::fusion::at_c<0>(output));
+  BOOST_CHECK_EQUAL(10, boost::fusion::at_c<1>(output));
+  BOOST_CHECK_EQUAL(false, node.full(0));
+}
+
+BOOST_AUTO_TEST_CASE(proc_node_take_inputs_tests)
+{
+  typedef boost::fusion::vector<int, int> pair_t;
+  my_proc_node<pair_t, pair_t> original;
+  my_proc_node<pair_t, pair_t> replacement;
+
+  // original holds one complete set and one with only component 0.
+  original.enqueue<0>(1);
+  original.enqueue<1>(10);
+  original.enqueue<0>(2);
+  replacement.enqueue<1>(20);
+  replacement.enqueue<0>(3);
+
+  replacement.take_inputs(original);
+  BOOST_CHECK_EQUAL(0u, original.queueSize());
+  BOOST_CHECK_EQUAL(false, original.is_ready());
+  BOOST_CHECK_EQUAL(3u, replacement.queueSize());
+
+  // Each component lines up after the ones original already held.
+  pair_t out = replacement.visit();
+  BOOST_CHECK_EQUAL(1, boost::fusion::at_c<0>(out));
+  BOOST_CHECK_EQUAL(10, boost::fusion::at_c<1>(out));
+  out = replacement.visit();
+  BOOST_CHECK_EQUAL(2, boost::fusion::at_c<0>(out));
+  BOOST_CHECK_EQUAL(20, boost::fusion::at_c<1>(out));
+  BOOST_CHECK_EQUAL(false, replacement.is_ready());
+
+  replacement.enqueue<1>(30);
+  out = replacement.visit();
+  BOOST_CHECK_EQUAL(3, boost::fusion::at_c<0>(out));
+  BOOST_CHECK_EQUAL(30, boost::fusion::at_c<1>(out));
+}
@@ -0,0 +1,221 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#define BOOST_TEST_MODULE QUEUE_TUNER_TEST
+#include <boost/test/unit_test.hpp>
+
+#include "output_batch.hpp"
+#include "queue_tuner.hpp"
+
+#include <boost/fusion/include/vector.hpp>
+
+#include <vector>
+
+//==============================================================================
+typedef boost::fusion::vector<int> single_t;
+
+class my_proc_node : public shared_proc_node<my_proc_node, single_t, single_t>
+{
+public:
+  explicit my_proc_node(size_t maxQueueSize, unsigned sleepMillis = 0)
+  : shared_proc_node<my_proc_node, single_t, single_t>(maxQueueSize),
+    m_sleepMillis(sleepMillis)
+  {}
+
+  single_t visit_impl()
+  {
+    if (m_sleepMillis)
+      boost::this_thread::sleep(boost::posix_time::milliseconds(m_sleepMillis));
+    return this->inputQueue().front();
+  }
+
+private:
+  unsigned m_sleepMillis;
+};
+
+struct decision_log
+{
+  void operator()(const tuning_decision & d) { decisions.push_back(d); }
+  std::vector<tuning_decision> decisions;
+};
+
+void produce(my_proc_node * node, int count)
+{
+  for (int i = 0; i < count; ++i)
+    node->enqueue<0>(i);
+}
+
+BOOST_AUTO_TEST_CASE(queue_tuner_grow_tests)
+{
+  my_proc_node node(4);
+  decision_log log;
+
+  queue_tuner tuner(queue_tuner::max_throughput, 0, 1, 16);
+  tuner.logger(boost::ref(log));
+  tuner.add(node, "grow");
+
+  // Nothing has happened yet, so nothing changes.
+  tuner.tune();
+  BOOST_CHECK_EQUAL(0u, log.decisions.size());
+
+  // The producer fills the queue and blocks.
+  boost::thread producer(boost::bind(& produce, & node, 100));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  BOOST_CHECK_EQUAL(4u, node.queueSize());
+
+  tuner.tune();
+  BOOST_REQUIRE_EQUAL(1u, log.decisions.size());
+  BOOST_CHECK_EQUAL(4u, log.decisions[0].oldValue);
+  BOOST_CHECK_EQUAL(8u, log.decisions[0].newValue);
+  BOOST_CHECK_EQUAL(8u, node.maxQueueSize());
+
+  // Raising the limit wakes the producer, which fills the larger queue.
+  boost::this_thread::sleep(boost::posix_time::milliseconds(50));
+  BOOST_CHECK_EQUAL(8u, node.queueSize());
+
+  tuner.tune();
+  tuner.tune();
+  BOOST_CHECK_EQUAL(16u, node.maxQueueSize());
+
+  node.maxQueueSize(0);
+  producer.join();
+  BOOST_CHECK_EQUAL(100u, node.queueSize());
+}
+
+BOOST_AUTO_TEST_CASE(queue_tuner_latency_tests)
+{
+  my_proc_node node(64, 2 /* ms per visit */);
+  decision_log log;
+
+  queue_tuner tuner(queue_tuner::target_latency, 10000 /* us */, 2, 128);
+  tuner.logger(boost::ref(log));
+  tuner.add(node, "shrink");
+
+  for (int i = 0; i < 4; ++i)
+  {
+    node.enqueue<0>(i);
+    node.visit();
+  }
+
+  // The queue is empty, so it is well within the target.
+  tuner.tune();
+  BOOST_CHECK_EQUAL(0u, log.decisions.size());
+  BOOST_CHECK_EQUAL(64u, node.maxQueueSize());
+
+  for (int i = 0; i < 4; ++i)
+  {
+    node.enqueue<0>(i);
+    node.visit();
+  }
+  for (int i = 0; i < 20; ++i)
+    node.enqueue<0>(i);
+
+  // ~2ms per visit allows ~5 queued inputs within the 10ms target.
+  tuner.tune();
+  BOOST_REQUIRE_EQUAL(1u, log.decisions.size());
+  BOOST_CHECK_EQUAL(64u, log.decisions[0].oldValue);
+  BOOST_CHECK_EQUAL(20u, log.decisions[0].queueSize);
+  BOOST_CHECK(node.maxQueueSize() >= 2);
+  BOOST_CHECK(node.maxQueueSize() <= 5);
+  BOOST_CHECK(log.decisions[0].visitMicros >= 2000.0);
+}
+
+//------------------------------------------------------------------------------
+void consume(my_proc_node * node, size_t count)
+{
+  for (size_t visits = 0; visits < count; )
+  {
+    if (node->is_ready())
+    {
+      node->visit();
+      ++visits;
+    }
+    else
+      boost::this_thread::yield();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(queue_tuner_drain_tests)
+{
+  my_proc_node node(4, 1 /* ms per visit */);
+  decision_log log;
+
+  queue_tuner tuner(queue_tuner::max_throughput, 0, 1, 16);
+  tuner.logger(boost::ref(log));
+  tuner.blockedThreshold(0.5);
+  tuner.add(node, "drain");
+
+  // A burst of 20 blocks the producer until the consumer, visiting about
+  // once a millisecond, has drained 16 of them: ~20% of a 100ms interval.
+  boost::thread consumer(boost::bind(& consume, & node, 20));
+  boost::thread producer(boost::bind(& produce, & node, 20));
+  boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+
+  boost::posix_time::seconds const timeout(5);
+  BOOST_REQUIRE(producer.timed_join(timeout));
+  BOOST_REQUIRE(consumer.timed_join(timeout));
+
+  // That is not sustained backpressure, so the queue is not grown.
+  tuner.tune();
+  BOOST_CHECK_EQUAL(0u, log.decisions.size());
+  BOOST_CHECK_EQUAL(4u, node.maxQueueSize());
+  BOOST_CHECK_EQUAL(0u, node.queueSize());
+}
+
+//------------------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(queue_tuner_batch_tests)
+{
+  my_proc_node node(0);
+  batched_edge<my_proc_node, 0, int> edge(node, 4, 1000000 /* 1s */);
+  decision_log log;
+
+  queue_tuner tuner(queue_tuner::max_throughput, 0, 1, 16);
+  tuner.logger(boost::ref(log));
+  tuner.add_edge(edge, "edge");
+
+  tuner.tune();
+  BOOST_CHECK_EQUAL(0u, log.decisions.size());
+
+  // Two full batches: larger ones would save handoffs.
+  for (int i = 0; i < 8; ++i)
+    edge.push(i);
+  tuner.tune();
+  BOOST_REQUIRE_EQUAL(1u, log.decisions.size());
+  BOOST_CHECK_EQUAL(tuning_decision::batch_size, log.decisions[0].setting);
+  BOOST_CHECK_EQUAL(4u, log.decisions[0].oldValue);
+  BOOST_CHECK_EQUAL(8u, log.decisions[0].newValue);
+  BOOST_CHECK_EQUAL(8u, edge.batchSize());
+
+  // A partial batch flushed at end of stream does not grow it further.
+  for (int i = 0; i < 3; ++i)
+    edge.push(i);
+  edge.flush();
+  tuner.tune();
+  BOOST_CHECK_EQUAL(1u, log.decisions.size());
+  BOOST_CHECK_EQUAL(8u, edge.batchSize());
+}
+
+BOOST_AUTO_TEST_CASE(queue_tuner_batch_latency_tests)
+{
+  my_proc_node node(0);
+  batched_edge<my_proc_node, 0, int> edge(node, 32, 1000000 /* 1s */);
+  decision_log log;
+
+  queue_tuner tuner(queue_tuner::target_latency, 1000 /* us */, 1, 64);
+  tuner.logger(boost::ref(log));
+  tuner.add_edge(edge, "edge");
+
+  // 32 components in no less than 20ms is at most 1.6 per ms, so a batch of
+  // 32 takes far longer than 1ms to fill.
+  for (int i = 0; i < 32; ++i)
+    edge.push(i);
+  boost::this_thread::sleep(boost::posix_time::milliseconds(20));
+
+  tuner.tune();
+  BOOST_REQUIRE_EQUAL(1u, log.decisions.size());
+  BOOST_CHECK_EQUAL(32u, log.decisions[0].oldValue);
+  BOOST_CHECK(edge.batchSize() <= 2);
+  BOOST_CHECK(log.decisions[0].publishRate > 0.0);
+}
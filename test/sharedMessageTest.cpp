@@ -0,0 +1,85 @@
+// (C) Copyright Jonathan Franklin 2011.
+// Use, modification and distribution are subject to the Boost Software License,
+// Version 1.0. (See accompanying file LICENSE_1_0.txt or copy at
+// http://www.boost.org/LICENSE_1_0.txt).
+
+#define BOOST_TEST_MODULE SHARED_MESSAGE_TEST
+#include <boost/test/unit_test.hpp>
+
+#include "proc_node.hpp"
+#include "shared_message.hpp"
+
+#include <boost/fusion/include/at_c.hpp>
+#include <boost/fusion/include/vector.hpp>
+
+#include <vector>
+
+//==============================================================================
+/** Counts how many times a payload is copied. */
+struct frame
+{
+  frame() : bytes() {}
+  explicit frame(size_t size) : bytes(size, 'x') {}
+  frame(const frame & rhs) : bytes(rhs.bytes) { ++copies; }
+  frame & operator=(const frame & rhs) { bytes = rhs.bytes; ++copies; return *this; }
+
+  std::vector<char> bytes;
+  static size_t copies;
+};
+size_t frame::copies = 0;
+
+void swap(frame & lhs, frame & rhs) { lhs.bytes.swap(rhs.bytes); }
+
+typedef shared_message<frame, local_ref_count> frame_msg;
+typedef boost::fusion::vector<frame_msg> input_t;
+typedef boost::fusion::vector<size_t>    output_t;
+
+class frame_node : public proc_node<frame_node, input_t, output_t>
+{
+public:
+  output_t visit_impl()
+  { return output_t(boost::fusion::at_c<0>(this->inputQueue().front())->bytes.size()); }
+};
+
+BOOST_AUTO_TEST_CASE(shared_message_basic_tests)
+{
+  shared_message<int> empty;
+  BOOST_CHECK_EQUAL(true, empty.empty());
+  BOOST_CHECK_EQUAL(0u, empty.use_count());
+
+  shared_message<int> a = make_message(42);
+  BOOST_CHECK_EQUAL(42, *a);
+  BOOST_CHECK_EQUAL(1u, a.use_count());
+  {
+    shared_message<int> b(a);
+    BOOST_CHECK(a == b);
+    BOOST_CHECK_EQUAL(2u, a.use_count());
+    empty = b;
+    BOOST_CHECK_EQUAL(3u, a.use_count());
+  }
+  BOOST_CHECK_EQUAL(2u, a.use_count());
+  empty.reset();
+  BOOST_CHECK_EQUAL(1u, a.use_count());
+  BOOST_CHECK(a != empty);
+}
+
+BOOST_AUTO_TEST_CASE(shared_message_fan_out_tests)
+{
+  frame payload(1 << 20);
+  frame::copies = 0;
+
+  frame_msg message = frame_msg::adopt(payload);
+  BOOST_CHECK_EQUAL(0u, frame::copies);
+  BOOST_CHECK_EQUAL(0u, payload.bytes.size());
+
+  std::vector<frame_node> consumers(6);
+  for (size_t n = 0; n < consumers.size(); ++n)
+    consumers[n].enqueue<0>(message);
+  BOOST_CHECK_EQUAL(7u, message.use_count());
+
+  for (size_t n = 0; n < consumers.size(); ++n)
+    BOOST_CHECK_EQUAL(size_t(1 << 20), boost::fusion::at_c<0>(consumers[n].visit()));
+
+  BOOST_CHECK_EQUAL(1u, message.use_count());
+  BOOST_CHECK_EQUAL(0u, frame::copies);
+}
@@ -20,6 +20,7 @@
 
 #include <deque>
 #include <string>
+#include <vector>
 
 //==============================================================================
 template<typename Input_T, typename Output_T>
@@ -85,3 +86,117 @@ BOOST_AUTO_TEST_CASE(shared_proc_node_tests)
   //boost::fusion::result_of::value_of<first>::type t = std::string();
 
 }
+
+//------------------------------------------------------------------------------
+int negate_first(const boost::fusion::vector<int, int> & input)
+{ return -boost::fusion::at_c<0>(input); }
+
+template<typename Node_T>
+std::vector<int> drain(Node_T & node)
+{
+  std::vector<int> values;
+  while (node.is_ready())
+    values.push_back(boost::fusion::at_c<0>(node.visit()));
+  return values;
+}
+
+BOOST_AUTO_TEST_CASE(shared_proc_node_overload_tests)
+{
+  typedef boost::fusion::vector<int> single_t;
+  typedef boost::fusion::vector<int, int> pair_t;
+
+  {
+    my_proc_node<single_t, single_t> node;
+    node.maxQueueSize(2);
+    BOOST_CHECK_EQUAL(block_producer, node.overloadPolicy());
+    node.overloadPolicy(drop_newest);
+    for (int i = 1; i <= 4; ++i)
+      node.enqueue<0>(i);
+
+    std::vector<int> values = drain(node);
+    BOOST_REQUIRE_EQUAL(2u, values.size());
+    BOOST_CHECK_EQUAL(1, values[0]);
+    BOOST_CHECK_EQUAL(2, values[1]);
+    BOOST_CHECK_EQUAL(2u, node.drops(drop_newest));
+    BOOST_CHECK_EQUAL(0u, node.drops(drop_oldest));
+  }
+
+  {
+    my_proc_node<single_t, single_t> node;
+    node.maxQueueSize(2);
+    node.overloadPolicy(drop_oldest);
+    for (int i = 1; i <= 4; ++i)
+      BOOST_CHECK_EQUAL(true, node.enqueue<0>(i));
+
+    std::vector<int> values = drain(node);
+    BOOST_REQUIRE_EQUAL(2u, values.size());
+    BOOST_CHECK_EQUAL(3, values[0]);
+    BOOST_CHECK_EQUAL(4, values[1]);
+    BOOST_CHECK_EQUAL(2u, node.drops(drop_oldest));
+  }
+
+  {
+    my_proc_node<single_t, single_t> node;
+    node.maxQueueSize(4);
+    node.overloadPolicy(drop_sampled);
+    for (int i = 1; i <= 100; ++i)
+      node.enqueue<0>(i);
+
+    // Whatever survived is still in arrival order.
+    std::vector<int> values = drain(node);
+    BOOST_REQUIRE_EQUAL(4u, values.size());
+    for (size_t i = 1; i < values.size(); ++i)
+      BOOST_CHECK(values[i - 1] < values[i]);
+    BOOST_CHECK_EQUAL(96u, node.drops(drop_sampled));
+  }
+
+  {
+    // Priority is the negated first component, so the set with the largest
+    // first component is evicted first.  The partially filled set at the back
+    // is never evicted.
+    my_proc_node<pair_t, pair_t> node;
+    node.maxQueueSize(3);
+    node.overloadPolicy(drop_lowest_priority);
+    node.priority(& negate_first);
+
+    int const firsts[] = { 5, 1, 9 };
+    for (int i = 0; i < 3; ++i)
+    {
+      node.enqueue<0>(firsts[i]);
+      node.enqueue<1>(i);
+    }
+    node.enqueue<0>(2);
+    BOOST_CHECK_EQUAL(3u, node.queueSize());
+    node.enqueue<1>(3);
+
+    std::vector<int> values = drain(node);
+    BOOST_REQUIRE_EQUAL(3u, values.size());
+    BOOST_CHECK_EQUAL(5, values[0]);
+    BOOST_CHECK_EQUAL(1, values[1]);
+    BOOST_CHECK_EQUAL(2, values[2]);
+    BOOST_CHECK_EQUAL(1u, node.drops(drop_lowest_priority));
+  }
+
+  {
+    // Dropping one component drops its whole set, so that later sets stay
+    // aligned even after a visit() frees a slot.
+    my_proc_node<pair_t, pair_t> node;
+    node.maxQueueSize(1);
+    node.overloadPolicy(drop_newest);
+
+    BOOST_CHECK_EQUAL(true, node.enqueue<0>(1));
+    BOOST_CHECK_EQUAL(true, node.enqueue<1>(10));
+    BOOST_CHECK_EQUAL(false, node.enqueue<0>(2));
+    BOOST_CHECK_EQUAL(1, boost::fusion::at_c<0>(node.visit()));
+
+    BOOST_CHECK_EQUAL(false, node.enqueue<1>(20));
+    BOOST_CHECK_EQUAL(0u, node.queueSize());
+    BOOST_CHECK_EQUAL(true, node.enqueue<0>(3));
+    BOOST_CHECK_EQUAL(true, node.enqueue<1>(30));
+
+    pair_t const out = node.visit();
+    BOOST_CHECK_EQUAL(3, boost::fusion::at_c<0>(out));
+    BOOST_CHECK_EQUAL(30, boost::fusion::at_c<1>(out));
+    BOOST_CHECK_EQUAL(1u, node.drops(drop_newest));
+  }
+}